@@ -17,6 +17,7 @@
 #include <stdint.h>
 
 #define ACTIVITY_NODEVICES	1
+#define ACTIVITY_PAGE_IMAGES	2	// The activity's touch button pages have pre-rendered screen images
 
 typedef struct _TouchButtonPage
 {
@@ -35,6 +36,7 @@ typedef struct _Activity
     uint32_t touchButtonPagesOffset;
     int deviceStateCount;
     uint32_t deviceStatesOffset;
+    uint32_t pageImagesOffset;		// Only with ACTIVITY_PAGE_IMAGES: a screen image offset per page, 0 if none
 } Activity;
 
 #endif /* ACTIVITY_H_ */
@@ -19,6 +19,7 @@
 #include "ir.h"
 #include "flash.h"
 #include "timer.h"
+#include "assertbrk.h"
 
 #define MAX_OPTIONS	64
 #define MAX_DEVICES 32
@@ -263,6 +264,9 @@ void deviceSetStatesParallel(const DeviceState* states, int stateCount)
     uint32_t lastTime = 0;
     uint32_t currTime = lastTime;
 
+    // TPM0 also drives the backlight PWM in ambient display, which has been left by the time an
+    // activity is switched; its MOD would overwrite this timer's, see TFT_BL_TPM_TIMER in lcd.c
+    ASSERTBRK(!(SIM_SCGC6 & SIM_SCGC6_TPM0_MASK));
     tpmEnableTimer(0);
     tpmStartTimer(0, TPM_CLOCKS_PER_MILLISECOND, 0);
 
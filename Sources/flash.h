@@ -32,6 +32,18 @@ extern uint8_t __FlashStoreBase[];
 extern uint8_t __FlashStoreLimit[];
 
 #define GET_FLASH_PTR(x) (__FlashStoreBase + sizeof(FlashDataHeader) + x)
+#define GET_FLASH_OFFSET(p) ((uint32_t) ((const uint8_t*) (p) - GET_FLASH_PTR(0)))
 #define FLASH_DATA_HEADER ((const FlashDataHeader*)(__FlashStoreBase))
 
+// Word aligned constants in code flash, such as glyphs, can be referred to by 16 bit word index,
+// which reaches the whole of the 128KB flash
+#define GET_CODE_WORD_INDEX(p) ((uint16_t) ((uintptr_t) (p) >> 2))
+#define GET_CODE_WORD_PTR(i) ((const void*) ((uintptr_t) (i) << 2))
+
+// Word aligned remote data, such as images, can be referred to by 16 bit word index in the same
+// way. The config compiler rejects objects so referred to that lie beyond FLASH_WORD_INDEX_MAX.
+#define FLASH_WORD_INDEX_MAX 0xffff
+#define GET_FLASH_WORD_INDEX(p) ((uint16_t) (GET_FLASH_OFFSET(p) >> 2))
+#define GET_FLASH_WORD_PTR(i) GET_FLASH_PTR(((uint32_t) (i) << 2))
+
 #endif /* FLASH_H_ */
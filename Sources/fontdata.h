@@ -17,11 +17,20 @@
 
 #include <stdint.h>
 
+// Glyph formats, named by bits per pixel:
+//   8bpp - one byte per pixel, 0x00 for ink.
+//   1bpp - each row packed into whole bytes, most significant bit first, set bits for ink.
+#define GLYPH_FORMAT_1BPP	1
+#define GLYPH_FORMAT_8BPP	8
+
+#define FONT_CODE_LIMIT		128	// Fonts are ASCII, so glyph tables cover codes below this
+
 typedef struct _Glyph
 {
     const uint8_t *data;
     uint8_t width;
     uint8_t height;
+    uint8_t format;
 } Glyph;
 
 typedef struct _Character
@@ -34,8 +43,18 @@ typedef struct _Font
 {
     int length;
     const Character *chars;
+    const Glyph *const *glyphs;	// Indexed by character code; NULL for codes without a glyph
 } Font;
 
+// Text laid out by the config compiler: glyph table indices, with the bounds of the whole run
+typedef struct _TextRun
+{
+    uint16_t width;
+    uint16_t height;
+    uint16_t length;
+    uint8_t codes[];
+} TextRun;
+
 extern const Font KiMony;
 
 #endif /* FONTDATA_H_ */
@@ -17,12 +17,37 @@
 
 #include <stdint.h>
 
+// Image formats; pixels are indices into the image's palette, with index 0 transparent.
+//   8BPP     - width bytes per row.
+//   8BPP_RLE - each row is a sequence of runs, each starting with a byte n. If bit 7 is set, it is
+//              an opaque run of (n & 0x7f) + 1 pixels, whose indices follow. Otherwise it skips
+//              n + 1 transparent pixels. The runs of a row add up to exactly its width.
+//   1BPP, 2BPP, 4BPP - each row packed into whole bytes, most significant bits first.
+#define IMAGE_FORMAT_8BPP		0
+#define IMAGE_FORMAT_8BPP_RLE	1
+#define IMAGE_FORMAT_1BPP		2
+#define IMAGE_FORMAT_2BPP		3
+#define IMAGE_FORMAT_4BPP		4
+
+#define IMAGE_RUN_OPAQUE_MASK	0x80
+#define IMAGE_RUN_LENGTH_MASK	0x7f
+
+// The format occupies what was the high byte of a 16 bit width, so configs packed before it was
+// added read as IMAGE_FORMAT_8BPP.
 typedef struct _Image
 {
-    uint16_t width;
+    uint8_t width;
+    uint8_t format;
     uint16_t height;
     uint32_t paletteOffset;
     uint32_t pixelsOffset;
 } Image;
 
+// A screen image, such as a touch button page pre-rendered by the config compiler, is RGB565
+// pixels for the whole screen in raster order, as a sequence of runs. Each starts with a 16 bit
+// word n. If bit 15 is set, it is a literal run of (n & 0x7fff) + 1 pixels, which follow.
+// Otherwise it repeats the colour in the following word n + 1 times. Runs may cross rows.
+#define SCREEN_IMAGE_RUN_LITERAL_MASK	0x8000
+#define SCREEN_IMAGE_RUN_LENGTH_MASK	0x7fff
+
 #endif /* IMAGE_H_ */
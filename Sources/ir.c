@@ -20,10 +20,11 @@
 #include "i2c.h"
 #include "timer.h"
 #include "interrupts.h"
+#include "flash.h"
 
 #define IR_I2C_ADDRESS	0x71
 #define IR_STAGE_COUNT  64
-#define IR_PACKET_SIZE(packet) (sizeof(packet->header) + sizeof(uint16_t) * packet->header.length)
+#define IR_PACKET_SIZE(header) (sizeof(IrPacketHeader) + sizeof(uint16_t) * (header)->length)
 #define IR_MAX_DURATION	65535
 
 typedef struct _IrPacketHeader
@@ -40,6 +41,15 @@ typedef struct _IrPacket
     uint16_t timing[IR_STAGE_COUNT];
 } IrPacket;
 
+// A packet encoded by the config compiler, stored as it is sent, after the time it takes to send
+// with its repeats and the quiet that follows
+typedef struct _IrStoredPacket
+{
+    uint32_t sendMs;
+    IrPacketHeader header;
+    uint16_t timing[];
+} IrStoredPacket;
+
 //-----------------------------------------------------------------------------
 // Encoding of infra-red packets
 //
@@ -257,12 +267,19 @@ static void sendIrPacket(IrPacket* packet, uint32_t endDelayUs)
     totalUs += (totalUs + packet->header.repeat_delay) * (packet->header.repeats - 1);
     totalUs += endDelayUs;
 
-    i2cSendBlock(IR_I2C_ADDRESS, &packet->header.start, IR_PACKET_SIZE(packet));
+    i2cSendBlock(IR_I2C_ADDRESS, &packet->header.start, IR_PACKET_SIZE(&packet->header));
 
     uint32_t totalMs = (totalUs + 999) / 1000;
     scheduleIrDelayMs(totalMs);
 }
 
+// Sends a packet straight from flash, as the config compiler encoded it
+static void sendIrStoredPacket(const IrStoredPacket* packet)
+{
+    i2cSendBlock(IR_I2C_ADDRESS, (uint8_t*) &packet->header.start, IR_PACKET_SIZE(&packet->header));
+    scheduleIrDelayMs(packet->sendMs);
+}
+
 static IrPacket irPacket;
 
 static void irSendRC6Code(uint32_t data, int bitCount)
@@ -277,6 +294,40 @@ static void irSendSIRCCode(uint32_t data, int bitCount)
     sendIrPacket(&irPacket, 45000);
 }
 
+// Sends one of an action's codes, with the toggle bits set or not, from its stored packet if it has
+// one, else encoding it
+static void irSendCode(const IrAction* action, int codeIndex, int toggled)
+{
+    const IrCode* code = action->codes + codeIndex;
+
+    if (code->encoding != IRCODE_NOP && (action->flags & IR_ACTION_PACKETS)) {
+        const uint32_t* packetOffsets = (const uint32_t*) (action->codes + action->codeCount);
+        sendIrStoredPacket((const IrStoredPacket*) GET_FLASH_PTR(packetOffsets[codeIndex * 2 + toggled]));
+        return;
+    }
+
+    unsigned int completedCode = code->code;
+
+    if (toggled) {
+        completedCode |= code->toggleMask;
+    }
+
+    switch (code->encoding) {
+        case IRCODE_NOP: {
+            scheduleIrDelayMs(code->code);
+            break;
+        }
+        case IRCODE_RC6: {
+            irSendRC6Code(completedCode, code->bits);
+            break;
+        }
+        case IRCODE_SIRC: {
+            irSendSIRCCode(completedCode, code->bits);
+            break;
+        }
+    }
+}
+
 static int irIsActionQueueEmpty()
 {
     return irActionQueueReadIndex == irActionQueueWriteIndex;
@@ -305,30 +356,14 @@ static void irProcessNextActionCode()
     } while (queueEntry->currentCode < 0);
 
     const IrCode* code = queueEntry->action->codes + queueEntry->currentCode;
-    unsigned int completedCode = code->code;
+    int toggled = 0;
 
     if (code->toggleMask) {
         *queueEntry->toggleFlag = !*queueEntry->toggleFlag;
-
-        if (*queueEntry->toggleFlag) {
-            completedCode |= code->toggleMask;
-        }
+        toggled = *queueEntry->toggleFlag;
     }
 
-    switch (code->encoding) {
-        case IRCODE_NOP: {
-            scheduleIrDelayMs(code->code);
-            break;
-        }
-        case IRCODE_RC6: {
-            irSendRC6Code(completedCode, code->bits);
-            break;
-        }
-        case IRCODE_SIRC: {
-            irSendSIRCCode(completedCode, code->bits);
-            break;
-        }
-    }
+    irSendCode(queueEntry->action, queueEntry->currentCode, toggled);
 }
 
 static void irQueueInterruptHandler(uint32_t tpm)
@@ -31,9 +31,14 @@ typedef struct _IrCode
     uint32_t toggleMask;
 } IrCode;
 
+#define IR_ACTION_PACKETS	0x0001	// Packets encoded by the config compiler follow the codes
+
+// With IR_ACTION_PACKETS, the codes are followed by two packet offsets for each: the packet as sent
+// with the toggle flag clear, then set. Both are 0 for a NOP.
 typedef struct _IrAction
 {
-    int codeCount;
+    uint16_t codeCount;
+    uint16_t flags;
     IrCode codes[];
 } IrAction;
 
@@ -15,7 +15,11 @@
 
 #include "MKL26Z4.h"
 #include "systick.h"
+#include "timer.h"
 #include "ports.h"
+#include "mathutil.h"
+#include "pixelkernels.h"
+#include "assertbrk.h"
 
 // Ports & pins to initialise:
 //  All as GPIO outputs
@@ -51,6 +55,14 @@ static const PortConfig portDPins = {
     { 3 }
 };
 
+static const PortConfig portDPinsPwm = {
+    PORTD_BASE_PTR,
+    ~(PORT_PCR_ISF_MASK | PORT_PCR_MUX_MASK),
+    PORT_PCR_MUX(4),	// TPM 0 CH 3
+    1,
+    { 3 }
+};
+
 static const PortConfig portEPins = {
     PORTE_BASE_PTR,
     ~(PORT_PCR_ISF_MASK | PORT_PCR_MUX_MASK),
@@ -85,6 +97,8 @@ static const PortConfig portEPinsOff = {
 
 static int backlightState = 0;
 static int sleepState = 0;
+static int ambientState = 0;
+static int backlightPwm = 0;
 
 #define TFT_PWR_MASK	(1 << 3)
 #define TFT_DC_MASK 	0x40000000U
@@ -93,6 +107,16 @@ static int sleepState = 0;
 #define TFT_CS_MASK		0x01000000U
 #define TFT_WR_MASK		0x02000000U
 
+// PTD3 only routes to TPM0 CH3, so the backlight shares TPM0 with the millisecond timer that
+// deviceSetStatesParallel() runs while switching activity. The two set the same clock source and
+// prescaler but a different MOD, and each gates TPM0's clock when it stops, so they must not
+// overlap. They don't: the timer runs only when awake, from events acted on after waking from
+// ambient display, and the PWM only in ambient display, which the main loop enters between events.
+#define TFT_BL_TPM_TIMER	0
+#define TFT_BL_TPM_CHANNEL	3
+#define TFT_BL_PWM_PERIOD	(TPM_CLOCKS_PER_MILLISECOND / 2)	// 2kHz, too fast to flicker
+#define TFT_BL_PWM_DIM		(TFT_BL_PWM_PERIOD / 8)				// Backlight on time in ambient display
+
 #define ILI9341_TFTWIDTH  240
 #define ILI9341_TFTHEIGHT 320
 
@@ -124,7 +148,11 @@ static int sleepState = 0;
 #define ILI9341_RAMRD   0x2E
 
 #define ILI9341_PTLAR   0x30
+#define ILI9341_VSCRDEF 0x33
 #define ILI9341_MADCTL  0x36
+#define ILI9341_VSCRSADD 0x37
+#define ILI9341_IDMOFF  0x38
+#define ILI9341_IDMON   0x39
 #define ILI9341_PIXFMT  0x3A
 
 #define ILI9341_FRMCTR1 0xB1
@@ -174,130 +202,83 @@ void tftWriteData(unsigned char byte)
     parallelWrite(byte);
 }
 
+#define TFT_INIT_DELAY	0x80	// Set in a command's data count when a delay in milliseconds follows its data
+
+#if defined(TFT_PIXELS_12BIT)
+#define TFT_PIXEL_FORMAT	0x53	// 12 bits per pixel on the MCU interface
+#else
+#define TFT_PIXEL_FORMAT	0x55	// 16 bits per pixel on the MCU interface
+#endif
+
+// Commands loading the panel's registers after a reset, each as the command, the number of data
+// bytes and the data, ending with a NOP. Delays are the minimums given in the ILI9341 datasheet.
+static const uint8_t tftInitCommands[] = {
+    ILI9341_SWRESET, TFT_INIT_DELAY, 5,     // Registers load their defaults within 5ms
+    ILI9341_DISPOFF, 0,
+    0xEF, 3, 0x03, 0x80, 0x02,
+    0xCF, 3, 0x00, 0xC1, 0x30,
+    0xED, 4, 0x64, 0x03, 0x12, 0x81,
+    0xE8, 3, 0x85, 0x00, 0x78,
+    0xCB, 5, 0x39, 0x2C, 0x00, 0x34, 0x02,
+    0xF7, 1, 0x20,
+    0xEA, 2, 0x00, 0x00,
+    ILI9341_PWCTR1, 1, 0x23,                // Power control: VRH[5:0]
+    ILI9341_PWCTR2, 1, 0x10,                // Power control: SAP[2:0], BT[3:0]
+    ILI9341_VMCTR1, 2, 0x3e, 0x28,          // VCM control
+    ILI9341_VMCTR2, 1, 0x86,                // VCM control 2
+    ILI9341_MADCTL, 1, 0x88,                // Memory access control: x -> x, y -> h - y
+    ILI9341_PIXFMT, 1, TFT_PIXEL_FORMAT,
+    ILI9341_FRMCTR1, 2, 0x00, 0x18,
+    ILI9341_DFUNCTR, 3, 0x08, 0x82, 0x27,   // Display function control
+    0xF2, 1, 0x00,                          // 3 gamma function disable
+    ILI9341_GAMMASET, 1, 0x01,              // Gamma curve selected
+    ILI9341_GMCTRP1, 15, 0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E, 0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00,
+    ILI9341_GMCTRN1, 15, 0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31, 0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F,
+    0xF6, 3, 0x01, 0x00, 0x20,
+    ILI9341_NOP
+};
+
+// Sends a table of commands and their data with chip select held low throughout
+static void tftWriteCommands(const uint8_t* commands)
+{
+    uint8_t command;
+
+    FGPIO_PCOR_REG(FGPIOE) = TFT_CS_MASK;
+
+    while ((command = *commands++) != ILI9341_NOP) {
+        uint8_t count = *commands++;
+        uint8_t dataCount = count & ~TFT_INIT_DELAY;
+
+        FGPIO_PCOR_REG(FGPIOE) = TFT_DC_MASK;
+        FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+        FGPIO_PDOR_REG(FGPIOC) = command;
+        FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+        FGPIO_PSOR_REG(FGPIOE) = TFT_DC_MASK;
+
+        while (dataCount--) {
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PDOR_REG(FGPIOC) = *commands++;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+        }
+
+        if (count & TFT_INIT_DELAY) {
+            sysTickDelayMs(*commands++);
+        }
+    }
+
+    FGPIO_PSOR_REG(FGPIOE) = TFT_CS_MASK;
+}
+
+// Resets the panel and loads its registers, leaving it asleep with the display off. Its memory can
+// be written while it sleeps, so a screen can be drawn before tftWake() shows it.
 void tftReset()
 {
     FGPIO_PCOR_REG(FGPIOE) = TFT_RS_MASK;	// LCD hardware reset
     FGPIO_PSOR_REG(FGPIOE) = TFT_RS_MASK;
 
-    tftWriteCmd(0x01);	// SW reset
-    sysTickDelayMs(5);
-    tftWriteCmd(0x28);	// display off
-
-    tftWriteCmd(0xEF);
-    tftWriteData(0x03);
-    tftWriteData(0x80);
-    tftWriteData(0x02);
-
-    tftWriteCmd(0xCF);
-    tftWriteData(0x00);
-    tftWriteData(0XC1);
-    tftWriteData(0X30);
-
-    tftWriteCmd(0xED);
-    tftWriteData(0x64);
-    tftWriteData(0x03);
-    tftWriteData(0X12);
-    tftWriteData(0X81);
-
-    tftWriteCmd(0xE8);
-    tftWriteData(0x85);
-    tftWriteData(0x00);
-    tftWriteData(0x78);
-
-    tftWriteCmd(0xCB);
-    tftWriteData(0x39);
-    tftWriteData(0x2C);
-    tftWriteData(0x00);
-    tftWriteData(0x34);
-    tftWriteData(0x02);
-
-    tftWriteCmd(0xF7);
-    tftWriteData(0x20);
-
-    tftWriteCmd(0xEA);
-    tftWriteData(0x00);
-    tftWriteData(0x00);
-
-    tftWriteCmd(ILI9341_PWCTR1);    //Power control
-    tftWriteData(0x23);             //VRH[5:0]
-
-    tftWriteCmd(ILI9341_PWCTR2);    //Power control
-    tftWriteData(0x10);             //SAP[2:0];BT[3:0]
-
-    tftWriteCmd(ILI9341_VMCTR1);    //VCM control
-    tftWriteData(0x3e);
-    tftWriteData(0x28);
-
-    tftWriteCmd(ILI9341_VMCTR2);    //VCM control2
-    tftWriteData(0x86);             //--
-
-    tftWriteCmd(ILI9341_MADCTL);    // Memory Access Control
-    tftWriteData(0x88);				// x -> x, y -> h - y
-
-    tftWriteCmd(ILI9341_PIXFMT);
-    tftWriteData(0x55);
-
-    tftWriteCmd(ILI9341_FRMCTR1);
-    tftWriteData(0x00);
-    tftWriteData(0x18);
-
-    tftWriteCmd(ILI9341_DFUNCTR);   // Display Function Control
-    tftWriteData(0x08);
-    tftWriteData(0x82);
-    tftWriteData(0x27);
-
-    tftWriteCmd(0xF2);              // 3Gamma Function Disable
-    tftWriteData(0x00);
-
-    tftWriteCmd(ILI9341_GAMMASET);  //Gamma curve selected
-    tftWriteData(0x01);
-
-    tftWriteCmd(ILI9341_GMCTRP1);   //Set Gamma
-    tftWriteData(0x0F);
-    tftWriteData(0x31);
-    tftWriteData(0x2B);
-    tftWriteData(0x0C);
-    tftWriteData(0x0E);
-    tftWriteData(0x08);
-    tftWriteData(0x4E);
-    tftWriteData(0xF1);
-    tftWriteData(0x37);
-    tftWriteData(0x07);
-    tftWriteData(0x10);
-    tftWriteData(0x03);
-    tftWriteData(0x0E);
-    tftWriteData(0x09);
-    tftWriteData(0x00);
-
-    tftWriteCmd(ILI9341_GMCTRN1);   //Set Gamma
-    tftWriteData(0x00);
-    tftWriteData(0x0E);
-    tftWriteData(0x14);
-    tftWriteData(0x03);
-    tftWriteData(0x11);
-    tftWriteData(0x07);
-    tftWriteData(0x31);
-    tftWriteData(0xC1);
-    tftWriteData(0x48);
-    tftWriteData(0x08);
-    tftWriteData(0x0F);
-    tftWriteData(0x0C);
-    tftWriteData(0x31);
-    tftWriteData(0x36);
-    tftWriteData(0x0F);
-
-    tftWriteCmd(0xF6);
-    tftWriteData(0x01);
-    tftWriteData(0x00);
-    tftWriteData(0x20);
-
-    tftWriteCmd(ILI9341_SLPOUT);    //Exit Sleep
+    tftWriteCommands(tftInitCommands);
 
-    sysTickDelayMs(120);
-
-    tftWriteCmd(ILI9341_DISPON);
-
-    sleepState = 0;
+    sleepState = 1;
 }
 
 struct TFTPixel
@@ -313,8 +294,8 @@ struct TFTPixel
     };
 };
 
-struct TFTPixel pixelBuffer[240];
-struct TFTPixel pixelBuffer2[240];
+static struct TFTPixel testPixelBuffer[240];
+static struct TFTPixel testPixelBuffer2[240];
 
 void fillPixelBuffer(struct TFTPixel* buffer, uint16_t colour)
 {
@@ -464,10 +445,10 @@ void drawTestRect_PEInline_SRAM(uint16_t colour)
 
     FGPIO_PCOR_REG(FGPIOE) = TFT_CS_MASK;
 
-    fillPixelBuffer(pixelBuffer, 0x1ff8);
+    fillPixelBuffer(testPixelBuffer, 0x1ff8);
 
     for (int y = 0; y < 320; y++) {
-        uint8_t* pixel_ptr = &pixelBuffer[0].lo;
+        uint8_t* pixel_ptr = &testPixelBuffer[0].lo;
 
         for (int x = 0; x < 240; x++, pixel_ptr += 2) {
             FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
@@ -509,7 +490,7 @@ void drawTestRect_PEInline_SRAM_PDOR(uint16_t colour)
     FGPIO_PCOR_REG(FGPIOE) = TFT_CS_MASK;
 
     for (int y = 0; y < 320; y++) {
-        uint8_t* pixel_ptr = &pixelBuffer[0].lo;
+        uint8_t* pixel_ptr = &testPixelBuffer[0].lo;
 
         for (int x = 0; x < 240; x++, pixel_ptr += 2) {
             FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
@@ -549,10 +530,10 @@ void drawTestRect_PEInline_SRAM_PDOR_BufferFill(uint16_t colour)
     FGPIO_PCOR_REG(FGPIOE) = TFT_CS_MASK;
 
     for (int y = 0; y < 320; y++) {
-        fillPixelBuffer(pixelBuffer, colour);
+        fillPixelBuffer(testPixelBuffer, colour);
         colour ^= 0xffff;
 
-        uint8_t* pixel_ptr = &pixelBuffer[0].lo;
+        uint8_t* pixel_ptr = &testPixelBuffer[0].lo;
 
         for (int x = 0; x < 240; x++, pixel_ptr += 2) {
             FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
@@ -619,18 +600,21 @@ void drawTestImage(uint16_t x0, uint16_t y0)
     FGPIO_PSOR_REG(FGPIOE) = TFT_CS_MASK;
 }
 
-volatile uint32_t tftDmaWriteBitMask = 0x2000;
-volatile uint32_t tftDmaFlag = 0;
+#define TFT_DMA_MUX_ALWAYS_ON	60	// DMAMUX source that always requests, so transfers run back to back
+
+volatile uint32_t tftDmaWriteBitMask = TFT_WR_MASK;
+volatile uint32_t tftDmaFlag = 1;	// Set when no DMA transfer is in progress
 
 void DMA2_IRQHandler()
 {
     tftDmaFlag = 1;
-    TPM1_SC = (TPM1_SC & ~TPM_SC_CMOD(0x03));
     DMA_DSR_BCR0 |= DMA_DSR_BCR_DONE_MASK;
     DMA_DSR_BCR1 |= DMA_DSR_BCR_DONE_MASK;
     DMA_DSR_BCR2 |= DMA_DSR_BCR_DONE_MASK;
 }
 
+// Each byte sent takes three linked DMA transfers on the slow GPIO port: write low, data, write high.
+// These run as fast as the DMA allows, about 4Mbytes/s, stealing bus cycles from the CPU between them.
 void tftInitDma()
 {
     // Configure DMA 2 interrupt
@@ -641,66 +625,45 @@ void tftInitDma()
     SIM_SCGC7 |= SIM_SCGC7_DMA_MASK;
     SIM_SCGC6 |= SIM_SCGC6_DMAMUX_MASK;
 
-    // Turn on TPM1 clock
-    SIM_SCGC6 |= SIM_SCGC6_TPM1_MASK;
-
     // Reset DMAMUX
     DMAMUX0_CHCFG0 = DMAMUX_CHCFG_SOURCE(0x00);
     DMAMUX0_CHCFG1 = DMAMUX_CHCFG_SOURCE(0x00);
     DMAMUX0_CHCFG2 = DMAMUX_CHCFG_SOURCE(0x00);
     DMAMUX0_CHCFG3 = DMAMUX_CHCFG_SOURCE(0x00);
 
-    // Configure DMA0 to drive write low then link to DMA1. Triggered by PIT0 or TPM1
+    // Configure DMA0 to drive write low then link to DMA1. Request is cleared when the count is done
     DMA_DCR0 = DMA_DCR_CS_MASK |
-    DMA_DCR_ERQ_MASK |
     DMA_DCR_D_REQ_MASK |
-    DMA_DCR_EADREQ_MASK | DMA_DCR_SSIZE(0x04) | DMA_DCR_DSIZE(0x04) | DMA_DCR_LINKCC(0x02) | DMA_DCR_LCH1(0x01);
+    DMA_DCR_EADREQ_MASK | DMA_DCR_SSIZE(0x00) | DMA_DCR_DSIZE(0x00) | DMA_DCR_LINKCC(0x02) | DMA_DCR_LCH1(0x01);
     DMA_SAR0 = (uint32_t) &tftDmaWriteBitMask;
-    DMA_DAR0 = (uint32_t) &((((GPIO_MemMapPtr) 0x400FF000u))->PCOR);
-    DMAMUX0_CHCFG0 = DMAMUX_CHCFG_SOURCE(55) | DMAMUX_CHCFG_ENBL_MASK;
+    DMA_DAR0 = (uint32_t) &GPIOE_PCOR;
+    DMAMUX0_CHCFG0 = DMAMUX_CHCFG_SOURCE(TFT_DMA_MUX_ALWAYS_ON) | DMAMUX_CHCFG_ENBL_MASK;
 
-    // Configure DMA1 to load data into GPIO, then link to DMA2.
+    // Configure DMA1 to load a data byte into GPIO, then link to DMA2.
     DMA_DCR1 = DMA_DCR_CS_MASK |
     DMA_DCR_SINC_MASK |
-    DMA_DCR_EADREQ_MASK | DMA_DCR_SSIZE(0x02) | DMA_DCR_DSIZE(0x02) | DMA_DCR_LINKCC(0x02) | DMA_DCR_LCH1(0x02);
-    DMA_DAR1 = (uint32_t) &((((GPIO_MemMapPtr) 0x400FF080u))->PDOR);
-    DMAMUX0_CHCFG1 = DMAMUX_CHCFG_SOURCE(61) | DMAMUX_CHCFG_ENBL_MASK;
+    DMA_DCR_EADREQ_MASK | DMA_DCR_SSIZE(0x01) | DMA_DCR_DSIZE(0x01) | DMA_DCR_LINKCC(0x02) | DMA_DCR_LCH1(0x02);
+    DMA_DAR1 = (uint32_t) &GPIOC_PDOR;
 
     // Configure DMA2 to drive write high, fire interrupt when count zero
     DMA_DCR2 = DMA_DCR_CS_MASK |
     DMA_DCR_EINT_MASK |
-    DMA_DCR_EADREQ_MASK | DMA_DCR_SSIZE(0x04) | DMA_DCR_DSIZE(0x04);
+    DMA_DCR_EADREQ_MASK | DMA_DCR_SSIZE(0x00) | DMA_DCR_DSIZE(0x00);
     DMA_SAR2 = (uint32_t) &tftDmaWriteBitMask;
-    DMA_DAR2 = (uint32_t) &((((GPIO_MemMapPtr) 0x400FF000u))->PSOR);
-    DMAMUX0_CHCFG2 = DMAMUX_CHCFG_SOURCE(62) | DMAMUX_CHCFG_ENBL_MASK;
-
-    // Configure TPM1 to drive DMA on overflow
-    TPM1_SC = 0;
-    TPM1_C0SC = TPM_CnSC_CHF_MASK;
-    TPM1_C1SC = TPM_CnSC_CHF_MASK;
-    TPM1_CONF &= (uint32_t) ~(uint32_t) (
-    TPM_CONF_CROT_MASK |
-    TPM_CONF_CSOO_MASK |
-    TPM_CONF_CSOT_MASK |
-    TPM_CONF_GTBEEN_MASK | TPM_CONF_DBGMODE(0x03) |
-    TPM_CONF_DOZEEN_MASK);
-    TPM1_MOD = TPM_MOD_MOD(8);	// 4Mhz
-    TPM1_SC = TPM_SC_DMA_MASK;
+    DMA_DAR2 = (uint32_t) &GPIOE_PSOR;
 
     tftDmaFlag = 1;
 }
 
+// Starts sending length bytes from source, with chip select already low
 void tftTriggerDma(uint32_t source, uint32_t length)
 {
     tftDmaFlag = 0;
     DMA_SAR1 = source;
     DMA_DSR_BCR0 = length * 4;
-    DMA_DSR_BCR1 = length * 2;
+    DMA_DSR_BCR1 = length;
     DMA_DSR_BCR2 = length * 4;
     DMA_DCR0 |= DMA_DCR_ERQ_MASK;
-
-    TPM1_CNT &= (uint32_t) ~(uint32_t) (TPM_CNT_COUNT(0xFFFF));
-    TPM1_SC = (TPM1_SC & ~TPM_SC_CMOD(0x03)) | TPM_SC_CMOD(0x01);
 }
 
 void drawTestRectDma()
@@ -726,19 +689,15 @@ void drawTestRectDma()
 
     FGPIO_PCOR_REG(FGPIOE) = TFT_CS_MASK;
 
-    fillPixelBuffer(pixelBuffer, 0x1ff8);
+    fillPixelBuffer(testPixelBuffer, 0x1ff8);
 
     for (unsigned int y = 0; y < 160; y++) {
-        tftTriggerDma((uint32_t) pixelBuffer, sizeof(pixelBuffer) / sizeof(pixelBuffer[0]) * 2);
-        fillPixelBuffer(pixelBuffer2, 0xf81f);
-        while (!tftDmaFlag) {
-            __asm("wfi");
-        }
-        tftTriggerDma((uint32_t) pixelBuffer2, sizeof(pixelBuffer2) / sizeof(pixelBuffer2[0]) * 2);
-        fillPixelBuffer(pixelBuffer, 0x1ff8);
-        while (!tftDmaFlag) {
-            __asm("wfi");
-        }
+        tftTriggerDma((uint32_t) testPixelBuffer, sizeof(testPixelBuffer) / sizeof(testPixelBuffer[0]) * 2);
+        fillPixelBuffer(testPixelBuffer2, 0xf81f);
+        tftBlitWait();
+        tftTriggerDma((uint32_t) testPixelBuffer2, sizeof(testPixelBuffer2) / sizeof(testPixelBuffer2[0]) * 2);
+        fillPixelBuffer(testPixelBuffer, 0x1ff8);
+        tftBlitWait();
     }
 
     FGPIO_PSOR_REG(FGPIOE) = TFT_CS_MASK;
@@ -768,20 +727,49 @@ void tftInit()
     tftSetupPorts();
     sysTickDelayMs(5);
     tftReset();
-    //tftInitDma();
+    tftWake();
+#if defined(TFT_DMA_BLIT)
+    tftInitDma();
+#endif
 }
 
-void tftSetBacklight(int status)
+// Lights the backlight fully, dimmed by PWM in ambient display, or not at all
+static void tftDriveBacklight(int status)
 {
-    if (sleepState) {
+    if (status && ambientState) {
+        ASSERTBRK(!(SIM_SCGC6 & SIM_SCGC6_TPM0_MASK));	// TPM0 is free, see TFT_BL_TPM_TIMER
+        FGPIO_PCOR_REG(FGPIOD) = TFT_BL_MASK;
+        portInitialise(&portDPinsPwm);
+        tpmStartPwm(TFT_BL_TPM_TIMER, TFT_BL_PWM_PERIOD, TFT_BL_TPM_CHANNEL, TFT_BL_PWM_DIM);
+        backlightPwm = 1;
         return;
     }
 
+    // The timer is only clocked while it runs
+    if (backlightPwm) {
+        tpmStopTimer(TFT_BL_TPM_TIMER);
+        tpmDisableTimer(TFT_BL_TPM_TIMER);
+        portInitialise(&portDPins);
+        backlightPwm = 0;
+    }
+
     if (status) {
         FGPIO_PSOR_REG(FGPIOD) = TFT_BL_MASK;
     } else {
         FGPIO_PCOR_REG(FGPIOD) = TFT_BL_MASK;
     }
+}
+
+// Turns the backlight on or off; while in ambient display, on is dimmed
+void tftSetBacklight(int status)
+{
+    if (sleepState) {
+        return;
+    }
+
+    if (status != backlightState) {
+        tftDriveBacklight(status);
+    }
 
     backlightState = status;
 }
@@ -793,6 +781,9 @@ int tftGetBacklight()
 
 void tftPowerOff()
 {
+    tftBlitWait();
+    ambientState = 0;
+    tftDriveBacklight(0);
     FGPIOB_PCOR = TFT_PWR_MASK;
     FGPIOC_PCOR = 0xff;
     FGPIOD_PCOR = TFT_BL_MASK;
@@ -803,6 +794,7 @@ void tftPowerOff()
     portInitialise(&portEPinsOff);
 }
 
+// Powers the panel up and resets it, leaving it asleep for the screen to be drawn before tftWake()
 void tftPowerOn()
 {
     tftSetupPorts();
@@ -810,8 +802,70 @@ void tftPowerOn()
     tftReset();
 }
 
+#if defined(TFT_PIXELS_12BIT)
+#define TFT_PACK_PIXELS		240		// Pixels packed for each DMA transfer
+
+static uint8_t tftPackBuffers[2][TFT_PACK_PIXELS / 2 * 3 + 3];
+static uint8_t tftPackBufferIndex = 0;
+static uint16_t tftPackCarry[2];		// A pixel left over from the last blit call, then its pair
+static uint8_t tftPackCarrying = 0;
+
+// Packs pixels to RGB444 pairs, starting with any pixel left over from the last call and leaving
+// over any odd one at the end, returning the number of bytes. Pairs run on across blit calls.
+static size_t tftPackPixels(uint8_t* packed, const uint16_t* pixels, size_t count)
+{
+    size_t bytes = 0;
+
+    if (tftPackCarrying && count) {
+        tftPackCarry[1] = *pixels++;
+        count--;
+        pixelKernelPack444(packed, tftPackCarry, 2);
+        bytes = 3;
+        tftPackCarrying = 0;
+    }
+
+    pixelKernelPack444(packed + bytes, pixels, count & ~1U);
+    bytes += (count >> 1) * 3;
+
+    if (count & 1) {
+        tftPackCarry[0] = pixels[count - 1];
+        tftPackCarrying = 1;
+    }
+
+    return bytes;
+}
+
+static void tftWriteBytes(const uint8_t* bytes, size_t count)
+{
+    while (count--) {
+        FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+        FGPIO_PDOR_REG(FGPIOC) = *bytes++;
+        FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+    }
+}
+
+// Sends a left over pixel on its own. The panel stores a pixel once its blue arrives, in the
+// second byte of a pair, so the third is not sent.
+static void tftFlushPackedPixel()
+{
+    if (tftPackCarrying) {
+        uint8_t bytes[3];
+
+        tftPackCarry[1] = 0;
+        pixelKernelPack444(bytes, tftPackCarry, 2);
+        tftWriteBytes(bytes, 2);
+        tftPackCarrying = 0;
+    }
+}
+#endif
+
 void tftStartBlit(int x, int y, int width, int height)
 {
+    tftBlitWait();
+#if defined(TFT_PIXELS_12BIT)
+    tftFlushPackedPixel();
+#endif
+
     int x1 = x + width - 1;
     int y1 = y + height - 1;
 
@@ -833,6 +887,17 @@ void tftStartBlit(int x, int y, int width, int height)
 
 void tftBlit(uint16_t* buffer, size_t pixels)
 {
+#if defined(TFT_PIXELS_12BIT)
+    tftBlitWait();
+
+    while (pixels) {
+        size_t chunk = MIN(pixels, TFT_PACK_PIXELS);
+
+        tftWriteBytes(tftPackBuffers[0], tftPackPixels(tftPackBuffers[0], buffer, chunk));
+        buffer += chunk;
+        pixels -= chunk;
+    }
+#else
     uint8_t* pixel_ptr = (uint8_t*) buffer;
 
     while (pixels >= 8) {
@@ -983,36 +1048,253 @@ void tftBlit(uint16_t* buffer, size_t pixels)
         ;
         FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
     }
+#endif
 }
 
-void tftClear(size_t pixels)
+// Queues a buffer to be sent by DMA and returns; the buffer must not be changed until the next
+// blit call, or tftBlitWait(), returns. Without TFT_DMA_BLIT this is the same as tftBlit().
+// With TFT_PIXELS_12BIT the buffer is packed into one of lcd.c's own before it is sent, a chunk
+// at a time while the chunk before is sent, so it may be changed straight away.
+void tftBlitAsync(uint16_t* buffer, size_t pixels)
 {
-    FGPIO_PDOR_REG(FGPIOC) = 0;
-    for (size_t x = 0; x < pixels; x++) {
-        FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
-        FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+#if defined(TFT_DMA_BLIT) && defined(TFT_PIXELS_12BIT)
+    while (pixels) {
+        size_t chunk = MIN(pixels, TFT_PACK_PIXELS);
+        uint8_t* packed = tftPackBuffers[tftPackBufferIndex];
+        size_t bytes = tftPackPixels(packed, buffer, chunk);
+
+        buffer += chunk;
+        pixels -= chunk;
+
+        if (bytes) {
+            tftBlitWait();
+            tftTriggerDma((uint32_t) packed, bytes);
+            tftPackBufferIndex ^= 1;
+        }
+    }
+#elif defined(TFT_DMA_BLIT)
+    tftBlitWait();
+    tftTriggerDma((uint32_t) buffer, pixels * sizeof(uint16_t));
+#else
+    tftBlit(buffer, pixels);
+#endif
+}
 
-        FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
-        FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+// Interrupts are masked between testing the flag and sleeping, so the DMA interrupt can't slip in
+// between and leave the CPU asleep until the next one; a pending interrupt still wakes wfi.
+void tftBlitWait()
+{
+    __disable_irq();
+    while (!tftDmaFlag) {
+        __asm("wfi");
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+}
+
+#if defined(TFT_PIXELS_12BIT)
+// Sends pixels of one colour as repeats of a packed pair's three bytes. Greys, whose components
+// match, give three matching bytes, so are sent with strobes alone.
+static void tftFillPacked(uint16_t colour, size_t pixels)
+{
+    uint16_t pair[2] = { colour, colour };
+    uint8_t bytes[3];
+
+    if (tftPackCarrying && pixels) {
+        tftWriteBytes(bytes, tftPackPixels(bytes, &colour, 1));
+        pixels--;
+    }
+
+    size_t pairs = pixels >> 1;
+
+    pixelKernelPack444(bytes, pair, 2);
+
+    if (bytes[0] == bytes[1] && bytes[1] == bytes[2]) {
+        FGPIO_PDOR_REG(FGPIOC) = bytes[0];
+
+        while (pairs--) {
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+        }
+    } else {
+        while (pairs--) {
+            tftWriteBytes(bytes, 3);
+        }
+    }
+
+    tftPackPixels(bytes, &colour, pixels & 1);
+}
+#endif
+
+// Sends pixels of one colour to the blit window. The write strobe alone clocks in whatever the
+// data bus holds, so the bus is only rewritten when the byte changes: a colour whose two bytes
+// match, as black and white do, is sent with strobes alone. Waits for any DMA blit to finish.
+void tftFill(uint16_t colour, size_t pixels)
+{
+#if defined(TFT_PIXELS_12BIT)
+    tftBlitWait();
+    tftFillPacked(colour, pixels);
+#else
+    uint32_t lo = colour & 0x00ffU;
+    uint32_t hi = colour >> 8;
+
+    tftBlitWait();
+    FGPIO_PDOR_REG(FGPIOC) = lo;
+
+    if (lo == hi) {
+        while (pixels >= 4) {
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+
+            pixels -= 4;
+        }
+
+        while (pixels--) {
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+        }
+    } else {
+        // The bus alternates between the two bytes, with no loads from a pixel buffer
+        while (pixels >= 2) {
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PDOR_REG(FGPIOC) = hi;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PDOR_REG(FGPIOC) = lo;
+
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PDOR_REG(FGPIOC) = hi;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PDOR_REG(FGPIOC) = lo;
+
+            pixels -= 2;
+        }
+
+        if (pixels) {
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PDOR_REG(FGPIOC) = hi;
+            FGPIO_PCOR_REG(FGPIOE) = TFT_WR_MASK;
+            FGPIO_PSOR_REG(FGPIOE) = TFT_WR_MASK;
+        }
     }
+#endif
+}
+
+// Scrolls the whole screen so that row y shows the row written as (y + offset) % height. Rows are
+// written bottom to top of the panel (MY in MADCTL), so the panel's scroll start runs the other way.
+void tftSetScrollOffset(uint16_t offset)
+{
+    uint16_t start = (ILI9341_TFTHEIGHT - offset % ILI9341_TFTHEIGHT) % ILI9341_TFTHEIGHT;
+
+    tftBlitWait();
+
+    tftWriteCmd(ILI9341_VSCRDEF);   // Vertical scrolling definition
+    tftWriteData(0);
+    tftWriteData(0);                // Top fixed area
+    tftWriteData(ILI9341_TFTHEIGHT >> 8);
+    tftWriteData(ILI9341_TFTHEIGHT & 0xFF); // Scrolling area
+    tftWriteData(0);
+    tftWriteData(0);                // Bottom fixed area
+
+    tftWriteCmd(ILI9341_VSCRSADD);  // Vertical scrolling start address
+    tftWriteData(start >> 8);
+    tftWriteData(start & 0xFF);
 }
 
 void tftEndBlit()
 {
+    tftBlitWait();
+#if defined(TFT_PIXELS_12BIT)
+    tftFlushPackedPixel();
+#endif
     FGPIO_PSOR_REG(FGPIOE) = TFT_CS_MASK;
     FGPIO_PDOR_REG(FGPIOC) = 0;
 }
 
 void tftSleep()
 {
+    tftBlitWait();
     tftWriteCmd(ILI9341_SLPIN);
     sysTickDelayMs(120);
     sleepState = 1;
 }
 
+// The panel takes commands 5ms after sleep out. It must then be left awake for 120ms before sleep
+// in, which the time to the sleep timeout always allows.
 void tftWake()
 {
     tftWriteCmd(ILI9341_SLPOUT);
-    sysTickDelayMs(120);
+    sysTickDelayMs(5);
+    tftWriteCmd(ILI9341_DISPON);
     sleepState = 0;
 }
+
+// Shows only screen rows [y, y + height) as drawn with no scroll offset, in the eight colours of
+// idle mode, under a dimmed backlight. The panel stops driving the other rows but keeps their
+// memory, and the strip can still be drawn to, at a fraction of the panel and backlight current.
+void tftEnterAmbient(int y, int height)
+{
+    // Memory rows run bottom up, from the MY bit of MADCTL
+    uint16_t startRow = ILI9341_TFTHEIGHT - y - height;
+    uint16_t endRow = ILI9341_TFTHEIGHT - 1 - y;
+
+    tftBlitWait();
+
+    tftWriteCmd(ILI9341_PTLAR);     // Partial area
+    tftWriteData(startRow >> 8);
+    tftWriteData(startRow & 0xFF);
+    tftWriteData(endRow >> 8);
+    tftWriteData(endRow & 0xFF);
+    tftWriteCmd(ILI9341_PTLON);
+    tftWriteCmd(ILI9341_IDMON);
+
+    ambientState = 1;
+
+    if (backlightState) {
+        tftDriveBacklight(backlightState);
+    }
+}
+
+// Shows the whole screen again in full colour, and the backlight fully if it is on. Nothing need
+// be redrawn, and unlike sleep out there is no delay before the panel takes commands.
+void tftExitAmbient()
+{
+    tftBlitWait();
+
+    tftWriteCmd(ILI9341_IDMOFF);
+    tftWriteCmd(ILI9341_NORON);
+
+    ambientState = 0;
+
+    if (backlightState) {
+        tftDriveBacklight(backlightState);
+    }
+}
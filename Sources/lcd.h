@@ -17,6 +17,14 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Define this to send blits queued with tftBlitAsync() by DMA, while the CPU carries on. The DMA
+// sends a row at about half the bit-banged speed, and steals bus cycles from rendering, so it only
+// pays where a row takes longer to render than to send; leave it off until measured on the device.
+//#define TFT_DMA_BLIT
+// Define this to send pixels to the panel as 12 bit RGB444, two in every three bytes, for a quarter
+// less bus traffic than RGB565. Callers still pass RGB565 pixels.
+//#define TFT_PIXELS_12BIT
+
 extern void tftInit();
 extern void tftSetBacklight(int status);
 extern int tftGetBacklight();
@@ -24,10 +32,15 @@ extern void tftSleep();
 extern void tftWake();
 extern void tftPowerOff();
 extern void tftPowerOn();
+extern void tftEnterAmbient(int y, int height);
+extern void tftExitAmbient();
 extern void tftStartBlit(int x, int y, int width, int height);
 extern void tftBlit(uint16_t* buffer, size_t pixels);
-extern void tftClear(size_t pixels);
+extern void tftBlitAsync(uint16_t* buffer, size_t pixels);
+extern void tftBlitWait();
+extern void tftFill(uint16_t colour, size_t pixels);
 extern void tftEndBlit();
+extern void tftSetScrollOffset(uint16_t offset);
 
 extern void drawTestRect_PEInline_FGPIO(uint16_t colour);
 extern void drawTestRect_PEInline_BME(uint16_t colour);
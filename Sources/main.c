@@ -25,6 +25,8 @@
 #include "ir.h"
 #include "flash.h"
 #include "renderer.h"
+#include "fontdata.h"
+#include "textwidget.h"
 #include "buttons.h"
 #include "touchbuttons.h"
 #include "accelerometer.h"
@@ -34,24 +36,32 @@
 #include "capelectrode.h"
 #include "slidergesture.h"
 #include "debugutils.h"
+#include "renderbench.h"
 
 //------------------------------------------
 // Build configuration control
 //------------------------------------------
 
 //#define TIME_FRAME_RATE           // Run a short frame rate test on start
+//#define RENDER_BENCHMARK          // Run renderer benchmark scenes on start (needs PROFILING defined)
 //#define DISABLE_KEYPAD            // Turns off keypad setup via I2C and capacitative slider reading
 //#define ENABLE_TIMER_PIN          // Enables a PWM output on pin A13 to validate timing
 //#define ENABLE_TIMESTAMP_TIMING   // Enables tick timestamping to help measure performance
 
-#define SLEEP_TIMEOUT		500	    // Time until backlight turns off when idle, in hundredths of a second
-#define SLEEP_TIMEOUT_LONG	1000    // Time until backlight turns off when idle after touching screen, in hundredths of a second
+#define SLEEP_TIMEOUT		500	    // Time until the screen dims to ambient display when idle, in hundredths of a second
+#define SLEEP_TIMEOUT_LONG	1000    // Time until the screen dims to ambient display when idle after touching screen, in hundredths of a second
+#define AMBIENT_TIMEOUT		3000	// Time in ambient display until the backlight turns off, in tenths of a second
+#define AMBIENT_HEIGHT		24		// Rows at the top of the screen left showing in ambient display
+#define AMBIENT_CLOCK_X		(SCREEN_WIDTH - 64)
+#define AMBIENT_CLOCK_Y		3
+#define PAGE_SCROLL_STEP	16		// Rows exposed per step when scrolling in a new touch page
 
 //------------------------------------------
 
 #define ACTIVE_LEVEL_AWAKE		0
-#define ACTIVE_LEVEL_SLEEP		1
-#define ACTIVE_LEVEL_DEEPSLEEP	2
+#define ACTIVE_LEVEL_AMBIENT	1
+#define ACTIVE_LEVEL_SLEEP		2
+#define ACTIVE_LEVEL_DEEPSLEEP	3
 
 #define ARRAY_LENGTH(x) (sizeof(x) / sizeof(x[0]))
 
@@ -65,8 +75,14 @@ static volatile uint8_t periodicTimerIrqCount = 0;
 static volatile uint32_t perfTimestamps[8];
 static volatile uint8_t perfTimestampIndex = 0;
 #define PERF_TIMESTAMP perfTimestamps[perfTimestampIndex++] = tpmGetTimeHighPrecision(TPM_TIMER_TIMESTAMPS); perfTimestampIndex &= 7
+static volatile uint32_t wakeToFirstPixelUs[3];	// Last time from waking to the screen showing in full, from ambient, sleep and deep sleep
+#define WAKE_TIMESTAMP_START uint32_t wakeStart = tpmGetTimeHighPrecision(TPM_TIMER_TIMESTAMPS)
+#define WAKE_TIMESTAMP_END(level) wakeToFirstPixelUs[(level) - 1] = (tpmGetTimeHighPrecision(TPM_TIMER_TIMESTAMPS) - wakeStart) * 1000 / TPM_CLOCKS_PER_MILLISECOND; \
+    debugSetOverlayHex(1, wakeToFirstPixelUs[(level) - 1])
 #else
 #define PERF_TIMESTAMP
+#define WAKE_TIMESTAMP_START
+#define WAKE_TIMESTAMP_END(level)
 #endif
 
 static void periodicTimerIrqHandler()
@@ -113,11 +129,101 @@ static void periodicTimerStop()
     periodicTimerIrqCount = 0;
 }
 
+// Gets the pre-rendered screen image of an activity's touch button page, or NULL if it has none
+static const uint16_t* getTouchPageImage(const Activity* activity, int page)
+{
+    if ((activity->flags & ACTIVITY_PAGE_IMAGES) && page < activity->touchButtonPageCount) {
+        const uint32_t* imageOffsets = (const uint32_t*) GET_FLASH_PTR(activity->pageImagesOffset);
+
+        if (imageOffsets[page]) {
+            return (const uint16_t*) GET_FLASH_PTR(imageOffsets[page]);
+        }
+    }
+
+    return NULL;
+}
+
+// Draws rows [0, rows) of the current touch page, clearing the screen behind them, then starts a
+// new draw list for the main loop
+static void drawTouchPageRows(uint16_t rows)
+{
+    const uint16_t* pageImage = getTouchPageImage(currentActivity, touchPage);
+
+    if (pageImage) {
+        ScreenImageStream stream;
+        rendererStartScreenImage(&stream, pageImage);
+        rendererBlitScreenImage(&stream, 0, rows);
+    } else {
+        touchbuttonsRedraw();
+        rendererNewDrawListStrip(0, rows);
+        do {
+            touchbuttonsRender();
+        } while (rendererRenderDrawList());
+    }
+
+    touchbuttonsRenderComplete();
+    rendererNewDrawList();
+}
+
 static uint32_t sleepCounter = SLEEP_TIMEOUT;
+static uint32_t ambientCounter = 0;
 static int activeLevel = ACTIVE_LEVEL_AWAKE;
+static TextWidget ambientClock;
+
+// Shows the time since the screen dimmed, as m:ss, in the ambient display's strip. The periodic
+// timer runs at ~10Hz in ambient display, so this is no more than a rough clock.
+static void updateAmbientClock()
+{
+    uint32_t seconds = ambientCounter / 10;
+    uint32_t minutes = seconds / 60;
+    char text[8];
+    char* c = text + sizeof(text);
+
+    *--c = '\0';
+    *--c = '0' + seconds % 10;
+    *--c = '0' + seconds / 10 % 6;
+    *--c = ':';
+    do {
+        *--c = '0' + minutes % 10;
+        minutes /= 10;
+    } while (minutes && c > text);
+
+    textWidgetSetText(&ambientClock, c);
+
+    rendererNewDrawList();
+    do {
+        textWidgetRender(&ambientClock);
+    } while (rendererRenderDrawList());
+    textWidgetRenderComplete(&ambientClock);
+    rendererNewDrawList();
+}
+
+// Dims the screen to the strip at its top, in eight colours, leaving the rest of the page in the
+// panel's memory for waking. The strip keeps the top of the page, with a clock drawn over it and
+// updated from the periodic timer.
+static void ambient()
+{
+    activeLevel = ACTIVE_LEVEL_AMBIENT;
+    ambientCounter = 0;
+    tftEnterAmbient(0, AMBIENT_HEIGHT);
+    textWidgetInit(&ambientClock, AMBIENT_CLOCK_X, AMBIENT_CLOCK_Y, &KiMony, 0xffff, 0x0000);
+    updateAmbientClock();
+    sliderGestureFlush();
+    periodicTimerStop();
+    periodicTimerStartSleep();
+    capElectrodeWakeableSleep(0);
+}
 
 static void sleep()
 {
+    // The strip is drawn back under the clock before normal display returns with the backlight
+    // off, so sleep out shows the page as it was
+    if (activeLevel == ACTIVE_LEVEL_AMBIENT) {
+        drawTouchPageRows(AMBIENT_HEIGHT);
+        tftSetBacklight(0);
+        tftExitAmbient();
+    }
+
     activeLevel = ACTIVE_LEVEL_SLEEP;
     tftSetBacklight(0);
     tftSleep();
@@ -147,17 +253,29 @@ static void sleepNow()
 static void wakeUp(uint32_t wake_time_hs)
 {
     if (activeLevel != ACTIVE_LEVEL_AWAKE) {
+        WAKE_TIMESTAMP_START;
         capElectrodeWake();
 
-        if (activeLevel == ACTIVE_LEVEL_DEEPSLEEP) {
-            tftPowerOn();
-            touchScreenConnect();
-            spiPinsConnect();
-            rendererClearScreen();
-            touchbuttonsRedraw();
+        if (activeLevel == ACTIVE_LEVEL_AMBIENT) {
+            // The panel kept the page, so it shows in full at once, and only the strip under the
+            // clock is drawn again
+            tftExitAmbient();
+            WAKE_TIMESTAMP_END(activeLevel);
+            drawTouchPageRows(AMBIENT_HEIGHT);
         } else {
+            if (activeLevel == ACTIVE_LEVEL_DEEPSLEEP) {
+                tftPowerOn();
+                touchScreenConnect();
+                spiPinsConnect();
+
+                // The panel is asleep until woken below, but its memory can be written, so the page
+                // is the first thing it shows
+                drawTouchPageRows(SCREEN_HEIGHT);
+            }
+
             tftWake();
             tftSetBacklight(1);
+            WAKE_TIMESTAMP_END(activeLevel);
         }
 
         periodicTimerStop();
@@ -203,7 +321,17 @@ void selectActivity(const Activity* activity)
             deviceSetStatesParallel((const DeviceState*) GET_FLASH_PTR(activity->deviceStatesOffset), activity->deviceStateCount);
         }
 
-        rendererClearScreen();
+        // A pre-rendered page is sent as it is, leaving nothing for the renderer to draw
+        const uint16_t* pageImage = getTouchPageImage(activity, 0);
+
+        if (pageImage) {
+            ScreenImageStream stream;
+            rendererStartScreenImage(&stream, pageImage);
+            rendererBlitScreenImage(&stream, 0, SCREEN_HEIGHT);
+            touchbuttonsRenderComplete();
+        } else {
+            rendererClearScreen();
+        }
     }
 }
 
@@ -213,6 +341,31 @@ void forceActivity(const Activity* activity)
     selectActivity(activity);
 }
 
+// Scrolls the new page up from the bottom of the screen. Each step scrolls the screen, then draws
+// the strip of the page it exposes into the rows that have wrapped round to the bottom, so the
+// page is sent once and the screen need not be cleared first. A pre-rendered page is streamed a
+// strip at a time instead of being drawn.
+static void scrollInTouchPage(const uint16_t* pageImage)
+{
+    ScreenImageStream stream;
+    rendererStartScreenImage(&stream, pageImage);
+
+    for (uint16_t y = 0; y < SCREEN_HEIGHT; y += PAGE_SCROLL_STEP) {
+        tftSetScrollOffset(y + PAGE_SCROLL_STEP);
+
+        if (pageImage) {
+            rendererBlitScreenImage(&stream, y, y + PAGE_SCROLL_STEP);
+        } else {
+            rendererNewDrawListStrip(y, y + PAGE_SCROLL_STEP);
+            do {
+                touchbuttonsRender();
+            } while (rendererRenderDrawList());
+        }
+    }
+
+    touchbuttonsRenderComplete();
+}
+
 void selectTouchPage(int page)
 {
     if (page < 0) {
@@ -226,12 +379,12 @@ void selectTouchPage(int page)
 
         if (page < currentActivity->touchButtonPageCount) {
             const TouchButtonPage* tbPages = (const TouchButtonPage*) GET_FLASH_PTR(currentActivity->touchButtonPagesOffset);
-            touchbuttonsSetActive((const TouchButton*) GET_FLASH_PTR(tbPages[page].touchButtonOffset), tbPages->touchButtonCount);
+            touchbuttonsSetActive((const TouchButton*) GET_FLASH_PTR(tbPages[page].touchButtonOffset), tbPages[page].touchButtonCount);
         } else {
             touchbuttonsSetActive(NULL, 0);
         }
 
-        rendererClearScreen();
+        scrollInTouchPage(getTouchPageImage(currentActivity, page));
     }
 }
 
@@ -285,6 +438,10 @@ void mainLoop()
 
     debugUtilsInit();
 
+#ifdef RENDER_BENCHMARK
+    renderBenchmarkRun();
+#endif
+
     const Activity* homeActivity = remoteInit();
     selectActivity(homeActivity);
 
@@ -294,8 +451,10 @@ void mainLoop()
     while (!sysTickCheckEvent()) {
         touchbuttonsRedraw();
         rendererNewDrawList();
-        touchbuttonsRender();
-        rendererRenderDrawList();
+        do {
+            touchbuttonsRender();
+        } while (rendererRenderDrawList());
+        touchbuttonsRenderComplete();
         frames++;
     }
 
@@ -324,7 +483,7 @@ void mainLoop()
         if (touchScreenCheckInterrupt()) {
             Point touch;
             if (touchScreenGetCoordinates(&touch)) {
-                if (tftGetBacklight()) {
+                if (activeLevel == ACTIVE_LEVEL_AWAKE) {
                     touchbuttonsProcessTouch(&touch);
                 }
                 wakeUp(SLEEP_TIMEOUT_LONG);
@@ -354,7 +513,16 @@ void mainLoop()
 
         if (periodicTimerIrqCount) {
             PERF_TIMESTAMP;
-            if (activeLevel == ACTIVE_LEVEL_SLEEP) {
+            if (activeLevel == ACTIVE_LEVEL_AMBIENT) {
+                ambientCounter += periodicTimerIrqCount;
+                periodicTimerIrqCount = 0;
+
+                if (ambientCounter >= AMBIENT_TIMEOUT) {
+                    sleep();
+                } else {
+                    updateAmbientClock();
+                }
+            } else if (activeLevel == ACTIVE_LEVEL_SLEEP) {
                 if (periodicTimerIrqCount > 150) {
                     deepSleep();
                 }
@@ -375,14 +543,16 @@ void mainLoop()
 
                 sleepCounter--;
                 if (sleepCounter == 0) {
-                    sleep();
+                    ambient();
                 }
             }
         }
 
         buttonsUpdate(&event);
-        touchbuttonsRender();
-        rendererRenderDrawList();
+        do {
+            touchbuttonsRender();
+        } while (rendererRenderDrawList());
+        touchbuttonsRenderComplete();
 
         if (event) {
             if (event->type == EVENT_IRACTION) {
@@ -0,0 +1,231 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * pixelkernels.c
+ *
+ *  Created on: 17 Oct 2016
+ *      Author: ntuckett
+ *
+ *  Inner loops writing RGB565 pixels into scanline buffers. Cycle counts for the Cortex-M0+
+ *  are tabulated in plan_&_notes.txt, and Tools/kernelbench.c times these against the
+ *  reference loops on a host.
+ */
+
+#include "pixelkernels.h"
+
+#ifndef PIXEL_KERNELS_REFERENCE
+
+// Fills the words from ptr up to end, which is a whole number of 4 word blocks further on
+static uint32_t* fillBlocks(uint32_t* ptr, uint32_t* end, uint32_t duo)
+{
+#if defined(PIXEL_KERNELS_STM) && defined(__ARM_ARCH_6M__)
+    // STM takes 1 + N cycles against 2 per STR, and the operands must be ascending low registers
+    register uint32_t* blockPtr asm("r0") = ptr;
+    register uint32_t* blockEnd asm("r1") = end;
+    register uint32_t duo0 asm("r2") = duo;
+    register uint32_t duo1 asm("r3") = duo;
+    register uint32_t duo2 asm("r4") = duo;
+    register uint32_t duo3 asm("r5") = duo;
+
+    __asm__ volatile (
+        "1:\n\t"
+        "stmia %0!, {%2, %3, %4, %5}\n\t"
+        "cmp %0, %1\n\t"
+        "bne 1b"
+        : "+l" (blockPtr)
+        : "l" (blockEnd), "l" (duo0), "l" (duo1), "l" (duo2), "l" (duo3)
+        : "cc", "memory");
+
+    return blockPtr;
+#else
+    do {
+        ptr[0] = duo;
+        ptr[1] = duo;
+        ptr[2] = duo;
+        ptr[3] = duo;
+        ptr += 4;
+    } while (ptr != end);
+
+    return ptr;
+#endif
+}
+
+#endif
+
+void pixelKernelFill(uint16_t* dst, int count, uint16_t colour)
+{
+#ifdef PIXEL_KERNELS_REFERENCE
+    while (count-- > 0) {
+        *dst++ = colour;
+    }
+#else
+    if ((((uintptr_t) dst) & 3) && count > 0) {
+        *dst++ = colour;
+        count--;
+    }
+
+    uint32_t duo = (uint32_t) colour | ((uint32_t) colour << 16);
+    uint32_t* words = (uint32_t*) dst;
+
+    if (count >= 8) {
+        words = fillBlocks(words, words + ((count >> 3) << 2), duo);
+        count &= 7;
+    }
+
+    while (count > 1) {
+        *words++ = duo;
+        count -= 2;
+    }
+
+    if (count > 0) {
+        *(uint16_t*) words = colour;
+    }
+#endif
+}
+
+void pixelKernelFillMasked(uint16_t* dst, uint8_t mask, uint16_t colour)
+{
+#ifndef PIXEL_KERNELS_REFERENCE
+    // Solid bytes are common in glyph stems and bars
+    if (mask == 0xff) {
+        pixelKernelFill(dst, 8, colour);
+        return;
+    }
+#endif
+
+    uint32_t bits = mask;
+
+    while (bits) {
+        if (bits & 0x80) {
+            *dst = colour;
+        }
+        bits = (bits << 1) & 0xff;
+        dst++;
+    }
+}
+
+void pixelKernelFillKeyed(uint16_t* dst, const uint8_t* src, int count, uint16_t colour)
+{
+#ifndef PIXEL_KERNELS_REFERENCE
+    while (count >= 4) {
+        uint8_t key0 = src[0];
+        uint8_t key1 = src[1];
+        uint8_t key2 = src[2];
+        uint8_t key3 = src[3];
+
+        // Groups without ink skip the per-pixel stores
+        if (!(key0 && key1 && key2 && key3)) {
+            if (!key0) {
+                dst[0] = colour;
+            }
+            if (!key1) {
+                dst[1] = colour;
+            }
+            if (!key2) {
+                dst[2] = colour;
+            }
+            if (!key3) {
+                dst[3] = colour;
+            }
+        }
+
+        src += 4;
+        dst += 4;
+        count -= 4;
+    }
+#endif
+
+    while (count-- > 0) {
+        if (!(*src++)) {
+            *dst = colour;
+        }
+        dst++;
+    }
+}
+
+void pixelKernelExpand(uint16_t* dst, const uint8_t* src, int count, const uint16_t* palette)
+{
+#ifndef PIXEL_KERNELS_REFERENCE
+    while (count >= 4) {
+        uint8_t index0 = src[0];
+        uint8_t index1 = src[1];
+        uint8_t index2 = src[2];
+        uint8_t index3 = src[3];
+
+        dst[0] = palette[index0];
+        dst[1] = palette[index1];
+        dst[2] = palette[index2];
+        dst[3] = palette[index3];
+
+        src += 4;
+        dst += 4;
+        count -= 4;
+    }
+#endif
+
+    while (count-- > 0) {
+        *dst++ = palette[*src++];
+    }
+}
+
+void pixelKernelExpandKeyed(uint16_t* dst, const uint8_t* src, int count, const uint16_t* palette)
+{
+#ifndef PIXEL_KERNELS_REFERENCE
+    while (count >= 4) {
+        uint8_t index0 = src[0];
+        uint8_t index1 = src[1];
+        uint8_t index2 = src[2];
+        uint8_t index3 = src[3];
+
+        // Wholly transparent groups are a single test
+        if (index0 | index1 | index2 | index3) {
+            if (index0) {
+                dst[0] = palette[index0];
+            }
+            if (index1) {
+                dst[1] = palette[index1];
+            }
+            if (index2) {
+                dst[2] = palette[index2];
+            }
+            if (index3) {
+                dst[3] = palette[index3];
+            }
+        }
+
+        src += 4;
+        dst += 4;
+        count -= 4;
+    }
+#endif
+
+    while (count-- > 0) {
+        uint8_t index = *src++;
+        if (index) {
+            *dst = palette[index];
+        }
+        dst++;
+    }
+}
+
+void pixelKernelPack444(uint8_t* dst, const uint16_t* src, int count)
+{
+    while (count > 1) {
+        uint32_t first = src[0];
+        uint32_t second = src[1];
+
+        // The top bits of each component: red and green, blue and red, then green and blue
+        dst[0] = ((first >> 8) & 0xf0) | ((first >> 7) & 0x0f);
+        dst[1] = ((first << 3) & 0xf0) | (second >> 12);
+        dst[2] = ((second >> 3) & 0xf0) | ((second >> 1) & 0x0f);
+
+        src += 2;
+        dst += 3;
+        count -= 2;
+    }
+}
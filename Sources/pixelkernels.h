@@ -0,0 +1,36 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * pixelkernels.h
+ *
+ *  Created on: 17 Oct 2016
+ *      Author: ntuckett
+ */
+
+#ifndef PIXELKERNELS_H_
+#define PIXELKERNELS_H_
+
+#include <stdint.h>
+
+#define PIXEL_KERNELS_STM            // Fill blocks of 8 pixels with one four word STM (Cortex-M0+ builds only)
+//#define PIXEL_KERNELS_REFERENCE    // Plain per-pixel loops, for checking the optimised kernels against
+
+// Fills count pixels with colour
+extern void pixelKernelFill(uint16_t* dst, int count, uint16_t colour);
+// Fills the pixels of the 8 starting at dst whose bits are set in mask, most significant bit first
+extern void pixelKernelFillMasked(uint16_t* dst, uint8_t mask, uint16_t colour);
+// Fills each of count pixels whose source byte is zero (8bpp glyph ink)
+extern void pixelKernelFillKeyed(uint16_t* dst, const uint8_t* src, int count, uint16_t colour);
+// Expands count palette indices to pixels
+extern void pixelKernelExpand(uint16_t* dst, const uint8_t* src, int count, const uint16_t* palette);
+// Expands count palette indices to pixels, leaving pixels with index 0 untouched
+extern void pixelKernelExpandKeyed(uint16_t* dst, const uint8_t* src, int count, const uint16_t* palette);
+// Packs count pixels, an even number, to RGB444 pairs of three bytes each, in the order the LCD takes them
+extern void pixelKernelPack444(uint8_t* dst, const uint16_t* src, int count);
+
+#endif /* PIXELKERNELS_H_ */
@@ -14,6 +14,36 @@
 #include "profiler.h"
 
 #ifdef PROFILING
+#include "renderer.h"
+
 ProfilerMetrics profilerMetrics;
-#endif
 
+// Accumulates an order-independent signature of blitted pixels, keyed on screen position.
+// Black pixels are skipped so the result matches a cleared screen whether or not they are sent.
+void profilerAddSignature(uint16_t x, uint16_t y, const uint16_t* buffer, size_t pixels)
+{
+    uint32_t position = y * SCREEN_WIDTH + x;
+
+    while (pixels--) {
+        uint16_t colour = *buffer++;
+
+        if (colour) {
+            uint32_t hash = (position * 2654435761U) ^ colour;
+            hash ^= hash >> 15;
+            hash *= 0x2c1b3c6dU;
+            hash ^= hash >> 12;
+            profilerMetrics.signature += hash;
+        }
+
+        position++;
+    }
+}
+
+// Adds pixels of one colour sent as a run, as if they had been blitted from a buffer
+void profilerAddFillSignature(uint16_t x, uint16_t y, uint16_t colour, size_t pixels)
+{
+    while (pixels--) {
+        profilerAddSignature(x++, y, &colour, 1);
+    }
+}
+#endif
@@ -18,6 +18,7 @@
 #ifdef PROFILING
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "systick.h"
 
 #define PROFILE_CATEGORY(category) uint32_t ctr_##category; uint32_t calls_##category
@@ -26,6 +27,9 @@
 #define PROFILE_EXIT(category) profilerMetrics.ctr_##category += sysTickGetCycleCount() - profileMark_##category; profilerMetrics.calls_##category++
 #define PROFILE_END sysTickStopCycleCount()
 #define PROFILE_REPORT(category) printf("%s: %d, %d\n", #category, profilerMetrics.ctr_##category, profilerMetrics.calls_##category)
+#define PROFILE_COUNT(category, count) profilerMetrics.ctr_##category += (count); profilerMetrics.calls_##category++
+#define PROFILE_SIGNATURE(x, y, buffer, pixels) { PROFILE_ENTER(signature); profilerAddSignature(x, y, buffer, pixels); PROFILE_EXIT(signature); }
+#define PROFILE_FILL_SIGNATURE(x, y, colour, pixels) { PROFILE_ENTER(signature); profilerAddFillSignature(x, y, colour, pixels); PROFILE_EXIT(signature); }
 
 typedef struct _ProfilerMetrics {
     PROFILE_CATEGORY(drawlist);
@@ -39,13 +43,27 @@ typedef struct _ProfilerMetrics {
     PROFILE_CATEGORY(rect);
     PROFILE_CATEGORY(text);
     PROFILE_CATEGORY(image);
+    PROFILE_CATEGORY(shape);
     PROFILE_CATEGORY(profileOuter);
     PROFILE_CATEGORY(profileInner);
     PROFILE_CATEGORY(blit);
+    PROFILE_CATEGORY(signature);
+    PROFILE_CATEGORY(dles);
+    PROFILE_CATEGORY(scanlines);
+    PROFILE_CATEGORY(blitBytes);
+    PROFILE_CATEGORY(fillBytes);
+    PROFILE_CATEGORY(damageRects);
+    PROFILE_CATEGORY(damageSaved);
+    PROFILE_CATEGORY(pixelWrites);
+    PROFILE_CATEGORY(bands);
+    uint32_t signature;
 }ProfilerMetrics;
 
 extern ProfilerMetrics profilerMetrics;
 
+extern void profilerAddSignature(uint16_t x, uint16_t y, const uint16_t* buffer, size_t pixels);
+extern void profilerAddFillSignature(uint16_t x, uint16_t y, uint16_t colour, size_t pixels);
+
 #else
 
 #define PROFILE_BEGIN
@@ -53,6 +71,9 @@ extern ProfilerMetrics profilerMetrics;
 #define PROFILE_EXIT(category)
 #define PROFILE_END
 #define PROFILE_REPORT(category)
+#define PROFILE_COUNT(category, count)
+#define PROFILE_SIGNATURE(x, y, buffer, pixels)
+#define PROFILE_FILL_SIGNATURE(x, y, colour, pixels)
 
 #endif
 
@@ -0,0 +1,485 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * renderbench.c
+ *
+ *  Created on: 17 Oct 2016
+ *      Author: ntuckett
+ */
+#ifdef PROFILING
+
+#include "renderbench.h"
+#include <stdio.h>
+#include <string.h>
+#include "MKL26Z4.h"
+#include "renderer.h"
+#include "touchbuttons.h"
+#include "fontdata.h"
+#include "image.h"
+#include "flash.h"
+#include "event.h"
+#include "activity.h"
+#include "remotedata.h"
+#include "profiler.h"
+#include "textwidget.h"
+
+#define BENCHMARK_FRAMES			8
+
+#define BENCHMARK_BUTTON_COLUMNS	4
+#define BENCHMARK_BUTTON_ROWS		6
+#define BENCHMARK_BUTTON_COUNT		(BENCHMARK_BUTTON_COLUMNS * BENCHMARK_BUTTON_ROWS)
+#define BENCHMARK_BUTTON_WIDTH		(SCREEN_WIDTH / BENCHMARK_BUTTON_COLUMNS)
+#define BENCHMARK_BUTTON_HEIGHT		(SCREEN_HEIGHT / BENCHMARK_BUTTON_ROWS)
+
+#define BENCHMARK_TEXT_LINE_HEIGHT	18
+
+#define BENCHMARK_IMAGE_COLUMNS		4
+#define BENCHMARK_IMAGE_ROWS		5
+#define BENCHMARK_IMAGE_CELL_WIDTH	(SCREEN_WIDTH / BENCHMARK_IMAGE_COLUMNS)
+#define BENCHMARK_IMAGE_CELL_HEIGHT	(SCREEN_HEIGHT / BENCHMARK_IMAGE_ROWS)
+#define BENCHMARK_MAX_IMAGES		8
+
+#define BENCHMARK_SHAPE_COLUMNS		4
+#define BENCHMARK_SHAPE_ROWS		6
+#define BENCHMARK_SHAPE_WIDTH		(SCREEN_WIDTH / BENCHMARK_SHAPE_COLUMNS)
+#define BENCHMARK_SHAPE_HEIGHT		(SCREEN_HEIGHT / BENCHMARK_SHAPE_ROWS)
+#define BENCHMARK_SHAPE_RADIUS		24
+#define BENCHMARK_GRADIENT_BANDS	8
+
+#define BENCHMARK_CLIP_HEIGHT		200	// Outer clip, within which two overlapping rectangles clip the test scene
+#define BENCHMARK_IMAGE_CLIP_X		(BENCHMARK_IMAGE_CELL_WIDTH / 2)	// Clip through the middle of the outer images
+#define BENCHMARK_IMAGE_CLIP_Y		(BENCHMARK_IMAGE_CELL_HEIGHT / 2)
+
+#define BENCHMARK_COUNTER_UPDATES	64
+#define BENCHMARK_COUNTER_STEP		0x13	// Carries into the second digit most updates, and further now and then
+#define BENCHMARK_COUNTER_Y			(SCREEN_HEIGHT - BENCHMARK_TEXT_LINE_HEIGHT)
+
+typedef struct _BenchmarkScene
+{
+    const char* name;
+    void (*draw)();
+    uint32_t goldenSignature;   // Signature of the scene on a cleared screen; zero if not yet recorded
+} BenchmarkScene;
+
+static const char* const buttonLabels[BENCHMARK_BUTTON_COUNT] = {
+    "Guide", "Enter", "Back", "Home",
+    "1", "2", "3", "Vol+",
+    "4", "5", "6", "Vol-",
+    "7", "8", "9", "Mute",
+    "Info", "0", "Menu", "Srce",
+    "Play", "Stop", "<<", ">>"
+};
+
+static const char* const textLines[] = {
+    "0123456789abcdef",
+    "!\"#$%&'()*+,-./:;<=>?@",
+    "ABCDEFGHIJKLMNOPQRSTU",
+    "VWXYZ[\\]^_`{|}~",
+    "abcdefghijklmnopqrstuvwxyz",
+    "Listen to radio",
+    "Watch Movie",
+    "Powering down...",
+    "Switching...",
+    "0000beef",
+    "deadbeef",
+    "00c0ffee",
+    "7fffffff"
+};
+
+static TouchButton benchmarkButtons[BENCHMARK_BUTTON_COUNT];
+static const Image* benchmarkImages[BENCHMARK_MAX_IMAGES];
+static int benchmarkImageCount = 0;
+
+static void drawTestScene()
+{
+    PROFILE_ENTER(drawlist);
+    rendererDrawTestScene();
+    PROFILE_EXIT(drawlist);
+}
+
+// Draw-list build time for this scene is measured by touchbuttonsRender
+static void drawButtonsScene()
+{
+    touchbuttonsSetActive(benchmarkButtons, BENCHMARK_BUTTON_COUNT);
+    touchbuttonsRender();
+}
+
+static void drawTextScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    for (int i = 0; i < sizeof(textLines) / sizeof(textLines[0]); i++) {
+        uint16_t width, height;
+        rendererGetStringBounds(textLines[i], &KiMony, &width, &height);
+        rendererDrawRect(0, i * BENCHMARK_TEXT_LINE_HEIGHT, width, height, 0x0000);
+        rendererDrawString(textLines[i], 0, i * BENCHMARK_TEXT_LINE_HEIGHT, &KiMony, 0xffff);
+    }
+
+    PROFILE_EXIT(drawlist);
+}
+
+static void drawImagesScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    for (int i = 0; i < BENCHMARK_IMAGE_COLUMNS * BENCHMARK_IMAGE_ROWS && benchmarkImageCount; i++) {
+        const Image* image = benchmarkImages[i % benchmarkImageCount];
+        uint16_t x = (i % BENCHMARK_IMAGE_COLUMNS) * BENCHMARK_IMAGE_CELL_WIDTH;
+        uint16_t y = (i / BENCHMARK_IMAGE_COLUMNS) * BENCHMARK_IMAGE_CELL_HEIGHT;
+
+        if (image->width <= BENCHMARK_IMAGE_CELL_WIDTH && image->height <= BENCHMARK_IMAGE_CELL_HEIGHT) {
+            rendererDrawRect(x, y, BENCHMARK_IMAGE_CELL_WIDTH, BENCHMARK_IMAGE_CELL_HEIGHT, 0x0000);
+            rendererSetDrawPriority(1);
+            rendererDrawImage(image, x + (BENCHMARK_IMAGE_CELL_WIDTH - image->width) / 2, y + (BENCHMARK_IMAGE_CELL_HEIGHT - image->height) / 2);
+            rendererSetDrawPriority(0);
+        }
+    }
+
+    PROFILE_EXIT(drawlist);
+}
+
+// Text over the whole screen, more than the draw list holds at once, so it is drawn in bands
+static void drawDenseTextScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    for (int i = 0; i < SCREEN_HEIGHT / BENCHMARK_TEXT_LINE_HEIGHT; i++) {
+        const char* text = textLines[i % (sizeof(textLines) / sizeof(textLines[0]))];
+        uint16_t width, height;
+        rendererGetStringBounds(text, &KiMony, &width, &height);
+        rendererDrawRect(0, i * BENCHMARK_TEXT_LINE_HEIGHT, width, height, 0x0000);
+        rendererDrawString(text, 0, i * BENCHMARK_TEXT_LINE_HEIGHT, &KiMony, 0xffff);
+    }
+
+    PROFILE_EXIT(drawlist);
+}
+
+// Rounded buttons, each a single box entry
+static void drawBoxesScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    for (int i = 0; i < BENCHMARK_SHAPE_COLUMNS * BENCHMARK_SHAPE_ROWS; i++) {
+        uint16_t x = (i % BENCHMARK_SHAPE_COLUMNS) * BENCHMARK_SHAPE_WIDTH;
+        uint16_t y = (i / BENCHMARK_SHAPE_COLUMNS) * BENCHMARK_SHAPE_HEIGHT;
+        rendererDrawBox(x, y, BENCHMARK_SHAPE_WIDTH, BENCHMARK_SHAPE_HEIGHT, 8, 2, 0xf9e0, 0xffff);
+    }
+
+    PROFILE_EXIT(drawlist);
+}
+
+// Alternate filled circles and rings
+static void drawCirclesScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    for (int i = 0; i < BENCHMARK_SHAPE_COLUMNS * BENCHMARK_SHAPE_ROWS; i++) {
+        uint16_t x = (i % BENCHMARK_SHAPE_COLUMNS) * BENCHMARK_SHAPE_WIDTH + BENCHMARK_SHAPE_WIDTH / 2;
+        uint16_t y = (i / BENCHMARK_SHAPE_COLUMNS) * BENCHMARK_SHAPE_HEIGHT + BENCHMARK_SHAPE_HEIGHT / 2;
+        uint8_t innerRadius = (i & 1) ? BENCHMARK_SHAPE_RADIUS - 6 : 0;
+        rendererDrawArc(x, y, BENCHMARK_SHAPE_RADIUS, innerRadius, RENDERER_QUADRANTS_ALL, 0x07ff);
+    }
+
+    PROFILE_EXIT(drawlist);
+}
+
+// Full width bands shaded alternately down and across
+static void drawGradientsScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    for (int i = 0; i < BENCHMARK_GRADIENT_BANDS; i++) {
+        uint16_t height = SCREEN_HEIGHT / BENCHMARK_GRADIENT_BANDS;
+
+        if (i & 1) {
+            rendererDrawHGradient(0, i * height, SCREEN_WIDTH, height, 0x001f, 0xffe0);
+        } else {
+            rendererDrawVGradient(0, i * height, SCREEN_WIDTH, height, 0xf800, 0x07ff);
+        }
+    }
+
+    PROFILE_EXIT(drawlist);
+}
+
+// The test scene through nested clip rectangles, which cut through its lines, rects, glyphs and
+// shapes on every side. Matches the unclipped scene within the union of the two inner rectangles.
+static void drawClippedTestScene()
+{
+    PROFILE_ENTER(drawlist);
+
+    rendererPushClip(0, 0, SCREEN_WIDTH, BENCHMARK_CLIP_HEIGHT);
+
+    rendererPushClip(20, 50, 140, 150);
+    rendererDrawTestScene();
+    rendererPopClip();
+
+    rendererPushClip(140, 100, 80, 120);
+    rendererDrawTestScene();
+    rendererPopClip();
+
+    rendererPopClip();
+
+    PROFILE_EXIT(drawlist);
+}
+
+// The images scene clipped through the middle of the images around its edges
+static void drawClippedImagesScene()
+{
+    rendererPushClip(BENCHMARK_IMAGE_CLIP_X, BENCHMARK_IMAGE_CLIP_Y, SCREEN_WIDTH - 2 * BENCHMARK_IMAGE_CLIP_X, SCREEN_HEIGHT - 2 * BENCHMARK_IMAGE_CLIP_Y);
+    drawImagesScene();
+    rendererPopClip();
+}
+
+static const BenchmarkScene scenes[] = {
+    { "test", drawTestScene, 0xba490fde },
+    { "buttons", drawButtonsScene, 0x680165f6 },
+    { "text", drawTextScene, 0xdca0d257 },
+    { "images", drawImagesScene, 0xc60a28e4 },  // Golden value holds for the bundled Resources/config.bin
+    { "dense", drawDenseTextScene, 0x2cee5a8b },
+    { "boxes", drawBoxesScene, 0xde699874 },
+    { "circles", drawCirclesScene, 0xa5156222 },
+    { "gradients", drawGradientsScene, 0xdbf73bb8 },
+    { "clipped test", drawClippedTestScene, 0xaba426e2 },
+    { "clipped images", drawClippedImagesScene, 0x3f3f6e18 },   // As for images
+};
+
+static void addBenchmarkImage(uint32_t imageOffset)
+{
+    if (imageOffset && benchmarkImageCount < BENCHMARK_MAX_IMAGES) {
+        const Image* image = (const Image*) GET_FLASH_PTR(imageOffset);
+
+        for (int i = 0; i < benchmarkImageCount; i++) {
+            if (benchmarkImages[i] == image) {
+                return;
+            }
+        }
+
+        benchmarkImages[benchmarkImageCount++] = image;
+    }
+}
+
+static void addActivityImages(const Activity* activity)
+{
+    const TouchButtonPage* pages = (const TouchButtonPage*) GET_FLASH_PTR(activity->touchButtonPagesOffset);
+
+    for (int p = 0; p < activity->touchButtonPageCount; p++) {
+        const TouchButton* buttons = (const TouchButton*) GET_FLASH_PTR(pages[p].touchButtonOffset);
+
+        for (int b = 0; b < pages[p].touchButtonCount; b++) {
+            addBenchmarkImage(buttons[b].imageOffsets[0]);
+            addBenchmarkImage(buttons[b].imageOffsets[1]);
+        }
+    }
+}
+
+// Images come from the remote data, reached via the activities the home activity's buttons select
+static void findBenchmarkImages()
+{
+    benchmarkImageCount = 0;
+
+    if (FLASH_DATA_HEADER->watermark != FLASH_DATA_WATERMARK) {
+        return;
+    }
+
+    const RemoteDataHeader* dataHeader = (const RemoteDataHeader*) GET_FLASH_PTR(0);
+    const Activity* homeActivity = (const Activity*) GET_FLASH_PTR(dataHeader->homeActivityOffset);
+    const TouchButtonPage* pages = (const TouchButtonPage*) GET_FLASH_PTR(homeActivity->touchButtonPagesOffset);
+
+    addActivityImages(homeActivity);
+
+    for (int p = 0; p < homeActivity->touchButtonPageCount; p++) {
+        const TouchButton* buttons = (const TouchButton*) GET_FLASH_PTR(pages[p].touchButtonOffset);
+
+        for (int b = 0; b < pages[p].touchButtonCount; b++) {
+            if (buttons[b].eventOffset) {
+                const Event* event = (const Event*) GET_FLASH_PTR(buttons[b].eventOffset);
+
+                if (event->type == EVENT_ACTIVITY) {
+                    addActivityImages((const Activity*) GET_FLASH_PTR(event->activityOffset));
+                }
+            }
+        }
+    }
+}
+
+static void setupBenchmarkButtons()
+{
+    for (int i = 0; i < BENCHMARK_BUTTON_COUNT; i++) {
+        TouchButton* button = benchmarkButtons + i;
+
+        memset(button, 0, sizeof(TouchButton));
+        button->textOffset = GET_FLASH_OFFSET(buttonLabels[i]);
+        button->x = (i % BENCHMARK_BUTTON_COLUMNS) * BENCHMARK_BUTTON_WIDTH;
+        button->y = (i / BENCHMARK_BUTTON_COLUMNS) * BENCHMARK_BUTTON_HEIGHT;
+        button->width = BENCHMARK_BUTTON_WIDTH;
+        button->height = BENCHMARK_BUTTON_HEIGHT;
+        button->colour = 0xf9e0;
+        button->flags = TB_PRESS_ACTIVATE | TB_CENTRE_TEXT;
+    }
+}
+
+static uint32_t perSecond(uint32_t count, uint32_t cycles)
+{
+    return cycles ? (uint32_t) (((uint64_t) count * SystemCoreClock) / cycles) : 0;
+}
+
+static void formatCounter(uint32_t value, char* buffer)
+{
+    static const char hexdigit[] = "0123456789abcdef";
+
+    for (int i = 28; i >= 0; i -= 4) {
+        *buffer++ = hexdigit[(value >> i) & 0xf];
+    }
+    *buffer = '\0';
+}
+
+// Updates a hex counter like a debug overlay, either clearing and redrawing its whole line or
+// through a text widget, printing the cost of each update
+static void benchmarkCounter(int useWidget)
+{
+    TextWidget widget;
+    char text[12];
+    uint32_t dles = 0;
+    uint32_t blitBytes = 0;
+    uint32_t cycles = 0;
+
+    rendererClearScreen();
+    textWidgetInit(&widget, 0, BENCHMARK_COUNTER_Y, &KiMony, 0xffff, 0x0000);
+
+    for (int update = 0; update < BENCHMARK_COUNTER_UPDATES; update++) {
+        formatCounter(update * BENCHMARK_COUNTER_STEP, text);
+        textWidgetSetText(&widget, text);
+
+        rendererNewDrawList();
+        do {
+            if (useWidget) {
+                textWidgetRender(&widget);
+            } else {
+                rendererDrawRect(0, BENCHMARK_COUNTER_Y, SCREEN_WIDTH, BENCHMARK_TEXT_LINE_HEIGHT, 0x0000);
+                rendererDrawString(text, 0, BENCHMARK_COUNTER_Y, &KiMony, 0xffff);
+            }
+        } while (rendererRenderDrawList());
+        textWidgetRenderComplete(&widget);
+
+        // The first update draws the whole counter either way
+        if (update > 0) {
+            dles += profilerMetrics.ctr_dles;
+            blitBytes += profilerMetrics.ctr_blitBytes;
+            cycles += profilerMetrics.ctr_drawlist + profilerMetrics.ctr_render - profilerMetrics.ctr_signature;
+        }
+    }
+
+    printf("bench counter %s: prims/update %u.%02u, bytes/update %u, cycles/update %u\n", useWidget ? "widget" : "full redraw",
+        (unsigned int) (dles / (BENCHMARK_COUNTER_UPDATES - 1)), (unsigned int) ((dles * 100 / (BENCHMARK_COUNTER_UPDATES - 1)) % 100),
+        (unsigned int) (blitBytes / (BENCHMARK_COUNTER_UPDATES - 1)), (unsigned int) (cycles / (BENCHMARK_COUNTER_UPDATES - 1)));
+}
+
+// Renders each scene a fixed number of times on a cleared screen, printing throughput figures
+// and checking the blitted output against the scene's golden signature.
+// Returns the number of scenes whose output did not match.
+int renderBenchmarkRun()
+{
+    int failures = 0;
+
+    setupBenchmarkButtons();
+    findBenchmarkImages();
+
+    for (int s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++) {
+        const BenchmarkScene* scene = scenes + s;
+        uint32_t buildCycles = 0;
+        uint32_t renderCycles = 0;
+        uint32_t dles = 0;
+        uint32_t scanlines = 0;
+        uint32_t blitBytes = 0;
+        uint32_t blitCycles = 0;
+        uint32_t fillBytes = 0;
+        uint32_t bands = 0;
+        uint32_t damageRects = 0;
+        uint32_t pixelWrites = 0;
+        uint32_t imageCycles = 0;
+        uint32_t imageSpans = 0;
+        uint32_t shapeCycles = 0;
+        uint32_t shapeSpans = 0;
+        uint32_t signature = 0;
+
+        for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+            rendererClearScreen();
+            rendererNewDrawList();
+
+            do {
+                scene->draw();
+            } while (rendererRenderDrawList());
+
+            buildCycles += profilerMetrics.ctr_drawlist;
+            renderCycles += profilerMetrics.ctr_render - profilerMetrics.ctr_signature;
+            dles += profilerMetrics.ctr_dles;
+            scanlines += profilerMetrics.ctr_scanlines;
+            blitBytes += profilerMetrics.ctr_blitBytes;
+            blitCycles += profilerMetrics.ctr_blit;
+            fillBytes += profilerMetrics.ctr_fillBytes;
+            bands += profilerMetrics.ctr_bands;
+            damageRects += profilerMetrics.ctr_damageRects;
+            pixelWrites += profilerMetrics.ctr_pixelWrites;
+            imageCycles += profilerMetrics.ctr_image;
+            imageSpans += profilerMetrics.calls_image;
+            shapeCycles += profilerMetrics.ctr_shape;
+            shapeSpans += profilerMetrics.calls_shape;
+
+            if (frame == 0) {
+                signature = profilerMetrics.signature;
+            } else if (signature != profilerMetrics.signature) {
+                printf("bench %s: frame %d signature %08x differs from first frame %08x\n", scene->name, frame,
+                    (unsigned int) profilerMetrics.signature, (unsigned int) signature);
+            }
+        }
+
+        printf("bench %s: prims/frame %u, lines/frame %u, bytes/frame %u, rects/frame %u, pixel writes/frame %u\n", scene->name,
+            (unsigned int) (dles / BENCHMARK_FRAMES), (unsigned int) (scanlines / BENCHMARK_FRAMES), (unsigned int) (blitBytes / BENCHMARK_FRAMES),
+            (unsigned int) (damageRects / BENCHMARK_FRAMES), (unsigned int) (pixelWrites / BENCHMARK_FRAMES));
+        printf("bench %s: build cycles/frame %u, render cycles/frame %u, prims/s %u, lines/s %u\n", scene->name,
+            (unsigned int) (buildCycles / BENCHMARK_FRAMES), (unsigned int) (renderCycles / BENCHMARK_FRAMES),
+            (unsigned int) perSecond(dles, buildCycles + renderCycles), (unsigned int) perSecond(scanlines, renderCycles));
+
+        // With DMA blits this is the time spent waiting for the previous scanline to be sent, plus
+        // that spent sending solid scanlines as runs
+        printf("bench %s: blit cycles/frame %u, cpu busy cycles/frame %u, bands/frame %u, run bytes/frame %u\n", scene->name,
+            (unsigned int) (blitCycles / BENCHMARK_FRAMES), (unsigned int) ((renderCycles - blitCycles) / BENCHMARK_FRAMES),
+            (unsigned int) (bands / BENCHMARK_FRAMES), (unsigned int) (fillBytes / BENCHMARK_FRAMES));
+
+        if (imageSpans) {
+            printf("bench %s: image spans/frame %u, cycles/image span %u\n", scene->name,
+                (unsigned int) (imageSpans / BENCHMARK_FRAMES), (unsigned int) (imageCycles / imageSpans));
+        }
+
+        // Each shape scene draws one kind of shape, so this is its cost per scanline
+        if (shapeSpans) {
+            printf("bench %s: shape spans/frame %u, cycles/shape span %u\n", scene->name,
+                (unsigned int) (shapeSpans / BENCHMARK_FRAMES), (unsigned int) (shapeCycles / shapeSpans));
+        }
+
+        if (!scene->goldenSignature) {
+            printf("bench %s: signature %08x (no golden value)\n", scene->name, (unsigned int) signature);
+        } else if (signature == scene->goldenSignature) {
+            printf("bench %s: signature %08x ok\n", scene->name, (unsigned int) signature);
+        } else {
+            printf("bench %s: signature %08x MISMATCH, expected %08x\n", scene->name, (unsigned int) signature,
+                (unsigned int) scene->goldenSignature);
+            failures++;
+        }
+    }
+
+    benchmarkCounter(0);
+    benchmarkCounter(1);
+
+    touchbuttonsSetActive(NULL, 0);
+    rendererClearScreen();
+
+    return failures;
+}
+
+#endif // #ifdef PROFILING
@@ -0,0 +1,27 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * renderbench.h
+ *
+ *  Created on: 17 Oct 2016
+ *      Author: ntuckett
+ */
+
+#ifndef RENDERBENCH_H_
+#define RENDERBENCH_H_
+#ifdef PROFILING
+
+extern int renderBenchmarkRun();
+
+#else
+
+#define renderBenchmarkRun() 0
+
+#endif
+
+#endif /* RENDERBENCH_H_ */
@@ -22,30 +22,52 @@
 #include "fontdata.h"
 #include "image.h"
 #include "profiler.h"
+#include "pixelkernels.h"
 
 #define DRAWLIST_BUFFER_SIZE	4608
-#define DLE_FLAG_ACTIVE_MASK	0x01
-#define DLE_FLAG_DRAWN_MASK		0x02
+#define DRAWLIST_BAND_KEEP		(DRAWLIST_BUFFER_SIZE * 15 / 16)	// Entries kept when the band shrinks on overflow
 #define DLE_TYPE_MASK			0xf0
+#define DLE_CLIPPED				0x08	// Entry is followed by the ClipWindow of it left visible
+#define DLE_PRIORITY_MASK		0x07
+#define DLE_NULL				0xffff	// Offset ending a list of entries
 
 #define DLE_TYPE_VLINE	0x10
 #define DLE_TYPE_HLINE	0x20
 #define DLE_TYPE_RECT	0x30
 #define DLE_TYPE_TXTCH	0x40
 #define DLE_TYPE_IMAGE	0x50
+#define DLE_TYPE_BOX	0x60
+#define DLE_TYPE_CIRCLE	0x70
+#define DLE_TYPE_VGRAD	0x80
+#define DLE_TYPE_HGRAD	0x90
 
+#define PENDING_BAND_SHIFT	3
+#define PENDING_BAND_COUNT	(SCREEN_HEIGHT >> PENDING_BAND_SHIFT)
+
+#define DAMAGE_RECT_COUNT	8
+#define DAMAGE_MERGE_SLACK	64	// Extra pixels worth blitting to avoid setting up another blit window
+
+#define ROW_SPAN_COUNT		16
+#define OCCLUDER_COUNT		16
+
+#define CLIP_STACK_DEPTH	4
+
+#define DLE_PTR(offset)		((DrawListEntry*) ((uint8_t*) drawListBuffer + (offset)))
+#define DLE_OFFSET(dle)		((uint16_t) ((uint8_t*) (dle) - (uint8_t*) drawListBuffer))
+
+// Entries hold only 16 bit fields, so pack at half word alignment. Links are offsets into the
+// draw list buffer, glyphs are code flash word indices and images are remote data word indices.
 typedef struct _DrawListEntry
 {
-    struct _DrawListEntry* next;
+    uint16_t next;
     uint8_t flags;
-    uint8_t size;
+    uint8_t x;			// The screen is narrower than 256 pixels
     uint16_t y;
 } DrawListEntry;
 
 typedef struct _LineDLE
 {
     DrawListEntry dle;
-    uint16_t x;
     uint16_t length;
     uint16_t colour;
 } LineDLE;
@@ -53,334 +75,1177 @@ typedef struct _LineDLE
 typedef struct _RectDLE
 {
     DrawListEntry dle;
-    uint16_t x;
     uint16_t width;
     uint16_t height;
     uint16_t colour;
 } RectDLE;
 
+// Glyph rows are found from the scanline, so need no pointer into the glyph data
 typedef struct _GlyphDLE
 {
     DrawListEntry dle;
-    uint16_t x;
     uint16_t colour;
-    const Glyph* glyph;
-    const uint8_t* data;
+    uint16_t glyph;
 } GlyphDLE;
 
 typedef struct _ImageDLE
 {
     DrawListEntry dle;
-    uint16_t x;
-    const Image* image;
-    const uint16_t* palette;
-    const uint8_t* pixels;
+    uint16_t image;
+    uint16_t row;	// Current row's offset in the pixels, advanced a scanline at a time as RLE rows vary in length
 } ImageDLE;
 
-uint8_t drawListBuffer[DRAWLIST_BUFFER_SIZE];
-DrawListEntry* activeDLEs = NULL;
-DrawListEntry** activeDLETail = &activeDLEs;
-DrawListEntry* pendingDLEs = NULL;
-DrawListEntry** pendingDLETail = &pendingDLEs;
+// A rectangle with rounded corners and a border, drawn as one entry. Corners are quarter circles
+// whose half widths are stepped from those of the last row drawn, see getCircleHalfWidth().
+typedef struct _BoxDLE
+{
+    DrawListEntry dle;
+    uint16_t width;
+    uint16_t height;
+    uint16_t colour;
+    uint16_t borderColour;
+    uint8_t radius;
+    uint8_t border;
+    uint8_t outerHalfWidth;
+    uint8_t innerHalfWidth;
+} BoxDLE;
+
+// A filled circle, or a ring when the inner radius is nonzero, drawn in the chosen quadrants
+typedef struct _CircleDLE
+{
+    DrawListEntry dle;
+    uint16_t colour;
+    uint8_t radius;
+    uint8_t innerRadius;
+    uint8_t quadrants;
+    uint8_t outerHalfWidth;
+    uint8_t innerHalfWidth;
+    uint8_t reserved;
+} CircleDLE;
+
+// Channels are stepped in 1/256ths of a level, so a row or pixel costs adds rather than a divide
+typedef struct _GradientDLE
+{
+    DrawListEntry dle;
+    uint16_t width;
+    uint16_t height;
+    uint16_t colour;	// Colour of the top row or left column
+    int16_t steps[3];	// Red, green and blue change per row or column
+} GradientDLE;
+
+// Part of a primitive left visible by the clip rectangle. The entry's position is that of the
+// visible part, and its rows and columns are found by adding the top and left offsets.
+typedef struct _ClipWindow
+{
+    uint16_t left;
+    uint16_t top;
+    uint16_t width;
+    uint16_t height;
+} ClipWindow;
+
+// Pending DLEs are bucketed into bands of scanlines by their starting y, each bucket kept in
+// insertion order so that entries starting on the same scanline activate in the order drawn.
+typedef struct _PendingBand
+{
+    uint16_t head;
+    uint16_t* tail;
+} PendingBand;
+
+// Damage rectangles are kept disjoint in y, so each scanline belongs to at most one of them
+// and every DLE lies entirely within one rectangle.
+typedef struct _DamageRect
+{
+    uint16_t x0, y0;
+    uint16_t x1, y1;
+} DamageRect;
+
+// Horizontal span of a scanline covered by opaque primitives
+typedef struct _RowSpan
+{
+    uint8_t x0;
+    uint8_t x1;
+} RowSpan;
+
+// Rectangle primitives are clipped to, which always lies within the screen
+typedef struct _ClipRect
+{
+    uint16_t x0, y0;
+    uint16_t x1, y1;
+} ClipRect;
+
+// Span of a scanline hidden from primitives of lower priority
+typedef struct _Occluder
+{
+    uint8_t x0;
+    uint8_t x1;
+    uint8_t priority;
+} Occluder;
+
+static const uint8_t drawListEntrySizes[] = {
+    0, sizeof(LineDLE), sizeof(LineDLE), sizeof(RectDLE), sizeof(GlyphDLE), sizeof(ImageDLE),
+    sizeof(BoxDLE), sizeof(CircleDLE), sizeof(GradientDLE), sizeof(GradientDLE)
+};
+
+uint16_t drawListBuffer[DRAWLIST_BUFFER_SIZE / sizeof(uint16_t)];
+uint16_t activeDLEs = DLE_NULL;
+uint16_t* activeDLETail = &activeDLEs;
+PendingBand pendingBands[PENDING_BAND_COUNT];
 
 size_t drawListEnd = 0;
+uint16_t bandMinY = 0;				// Scanlines of the current band; primitives outside it are dropped
+uint16_t bandMaxY = SCREEN_HEIGHT;
+uint16_t frameMaxY = SCREEN_HEIGHT;	// End of the scanlines drawn by this frame's bands
+int drawListClearsBand = 0;			// Set when every scanline of each band is rendered, not just those drawn on
+int drawListBands = 0;				// Bands rendered so far this frame
 uint16_t drawListMinX = SCREEN_WIDTH;
 uint16_t drawListMinY = SCREEN_HEIGHT;
 uint16_t drawListMaxX = 0;
 uint16_t drawListMaxY = 0;
-uint16_t pixelBuffer[SCREEN_WIDTH];
-uint8_t rowMinX[SCREEN_HEIGHT];
-uint8_t rowMaxX[SCREEN_HEIGHT];
-
-static DrawListEntry* allocDrawListEntry(size_t bytes)
-{
-    if (drawListEnd + bytes < DRAWLIST_BUFFER_SIZE) {
-        DrawListEntry* dle = (DrawListEntry*) (drawListBuffer + drawListEnd);
-        dle->size = bytes;
-        dle->next = NULL;
-        drawListEnd += bytes;
-        return dle;
+DamageRect damageRects[DAMAGE_RECT_COUNT];
+int damageRectCount = 0;
+uint16_t pixelBuffers[2][SCREEN_WIDTH];	// One is rendered into while the other is sent to the LCD
+uint16_t* pixelBuffer = pixelBuffers[0];
+RowSpan rowSpans[ROW_SPAN_COUNT];
+int rowSpanCount = 0;
+Occluder occluders[OCCLUDER_COUNT];
+int occluderCount = 0;
+uint8_t drawPriority = 0;
+ClipRect clipStack[CLIP_STACK_DEPTH];
+int clipDepth = 0;
+ClipRect clipRect = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+
+static void shrinkDrawListBand();
+
+// Allocates an entry for a primitive covering scanlines [y, y + height), or returns NULL if it lies
+// outside the current band. When the buffer is full the band is shrunk until the entry fits; only
+// if a single scanline's primitives overflow the buffer is the entry dropped.
+static DrawListEntry* allocDrawListEntry(size_t bytes, uint16_t y, uint16_t height)
+{
+    while (y < bandMaxY && y + height > bandMinY) {
+        if (drawListEnd + bytes < DRAWLIST_BUFFER_SIZE) {
+            DrawListEntry* dle = DLE_PTR(drawListEnd);
+            dle->next = DLE_NULL;
+            drawListEnd += bytes;
+            PROFILE_COUNT(dles, 1);
+            return dle;
+        }
+
+        if (bandMaxY - bandMinY == 1) {
+            break;
+        }
+
+        shrinkDrawListBand();
+    }
+
+    return NULL;
+}
+
+// Entries starting above the band are pending from its first scanline, and clipped when activated
+static void insertPendingDrawListEntry(DrawListEntry* dle)
+{
+    PendingBand* band = pendingBands + (MAX(dle->y, bandMinY) >> PENDING_BAND_SHIFT);
+
+    *band->tail = DLE_OFFSET(dle);
+    band->tail = &dle->next;
+}
+
+static uint8_t getDrawListEntrySize(const DrawListEntry* dle)
+{
+    uint8_t size = drawListEntrySizes[(dle->flags & DLE_TYPE_MASK) >> 4];
+    return (dle->flags & DLE_CLIPPED) ? size + sizeof(ClipWindow) : size;
+}
+
+static const ClipWindow* getClipWindow(const DrawListEntry* dle)
+{
+    return (const ClipWindow*) ((const uint8_t*) dle + drawListEntrySizes[(dle->flags & DLE_TYPE_MASK) >> 4]);
+}
+
+static const Glyph* getGlyph(const GlyphDLE* textChar)
+{
+    return (const Glyph*) GET_CODE_WORD_PTR(textChar->glyph);
+}
+
+static const Image* getImage(const ImageDLE* image)
+{
+    return (const Image*) GET_FLASH_WORD_PTR(image->image);
+}
+
+static const uint8_t* getImageRow(const ImageDLE* imageDle, const Image* image)
+{
+    return (const uint8_t*) GET_FLASH_PTR(image->pixelsOffset) + imageDle->row;
+}
+
+static uint32_t damageRectArea(const DamageRect* rect)
+{
+    return (uint32_t) (rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+}
+
+static void unionDamageRect(DamageRect* rect, const DamageRect* other)
+{
+    rect->x0 = MIN(rect->x0, other->x0);
+    rect->y0 = MIN(rect->y0, other->y0);
+    rect->x1 = MAX(rect->x1, other->x1);
+    rect->y1 = MAX(rect->y1, other->y1);
+}
+
+// Extra pixels that would be blitted if both rectangles were sent as their union
+static uint32_t damageMergeCost(const DamageRect* rect, const DamageRect* other)
+{
+    DamageRect merged = *rect;
+    unionDamageRect(&merged, other);
+    return damageRectArea(&merged) - damageRectArea(rect) - damageRectArea(other);
+}
+
+static void removeDamageRect(int index)
+{
+    damageRects[index] = damageRects[--damageRectCount];
+}
+
+static void addDamageRect(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    DamageRect rect = { x0, y0, x1, y1 };
+    int merged;
+
+    do {
+        merged = 0;
+
+        for (int i = 0; i < damageRectCount && !merged; i++) {
+            DamageRect* other = damageRects + i;
+
+            if ((rect.y0 < other->y1 && other->y0 < rect.y1) || damageMergeCost(&rect, other) <= DAMAGE_MERGE_SLACK) {
+                unionDamageRect(&rect, other);
+                removeDamageRect(i);
+                merged = 1;
+            }
+        }
+
+        if (!merged && damageRectCount == DAMAGE_RECT_COUNT) {
+            int cheapest = 0;
+            uint32_t cheapestCost = damageMergeCost(&rect, damageRects);
+
+            for (int i = 1; i < damageRectCount; i++) {
+                uint32_t cost = damageMergeCost(&rect, damageRects + i);
+                if (cost < cheapestCost) {
+                    cheapest = i;
+                    cheapestCost = cost;
+                }
+            }
+
+            unionDamageRect(&rect, damageRects + cheapest);
+            removeDamageRect(cheapest);
+            merged = 1;
+        }
+    } while (merged);
+
+    damageRects[damageRectCount++] = rect;
+}
+
+static void updateDrawListBounds(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    if (x0 > x1) {
+        SWAPNUM(x0, x1);
+    }
+
+    if (y0 > y1) {
+        SWAPNUM(y0, y1);
+    }
+
+    y0 = MAX(y0, bandMinY);
+    y1 = MIN(y1, bandMaxY);
+    x0 = MAX(x0, 0);
+    x1 = MIN(x1, SCREEN_WIDTH);
+
+    if (x0 < drawListMinX) {
+        drawListMinX = x0;
+    }
+
+    if (x1 > drawListMaxX) {
+        drawListMaxX = x1;
+    }
+
+    if (y0 < drawListMinY) {
+        drawListMinY = y0;
+    }
+
+    if (y1 > drawListMaxY) {
+        drawListMaxY = y1;
+    }
+
+    addDamageRect(x0, y0, x1, y1);
+}
+
+// Adds a span to the scanline's sorted coverage list, merging it with any spans it overlaps or touches.
+// If the list is full the span is merged with its nearest neighbour and the gap between them cleared,
+// which is safe as nothing has been drawn to the scanline yet.
+static void addRowSpan(uint16_t x0, uint16_t x1, uint16_t minX, uint16_t maxX)
+{
+    x0 = MAX(x0, minX);
+    x1 = MIN(x1, maxX);
+
+    if (x0 >= x1) {
+        return;
+    }
+
+    int i = 0;
+    while (i < rowSpanCount && rowSpans[i].x1 < x0) {
+        i++;
+    }
+
+    if (i == rowSpanCount || rowSpans[i].x0 > x1) {
+        if (rowSpanCount < ROW_SPAN_COUNT) {
+            for (int j = rowSpanCount; j > i; j--) {
+                rowSpans[j] = rowSpans[j - 1];
+            }
+
+            rowSpans[i].x0 = x0;
+            rowSpans[i].x1 = x1;
+            rowSpanCount++;
+            return;
+        }
+
+        if (i == rowSpanCount || (i > 0 && x0 - rowSpans[i - 1].x1 < rowSpans[i].x0 - x1)) {
+            i--;
+            pixelKernelFill(pixelBuffer + rowSpans[i].x1 - minX, x0 - rowSpans[i].x1, 0);
+        } else {
+            pixelKernelFill(pixelBuffer + x1 - minX, rowSpans[i].x0 - x1, 0);
+        }
+    }
+
+    rowSpans[i].x0 = MIN(rowSpans[i].x0, x0);
+    rowSpans[i].x1 = MAX(rowSpans[i].x1, x1);
+
+    int j = i + 1;
+    while (j < rowSpanCount && rowSpans[j].x0 <= rowSpans[i].x1) {
+        rowSpans[i].x1 = MAX(rowSpans[i].x1, rowSpans[j].x1);
+        j++;
+    }
+
+    if (j > i + 1) {
+        int removed = j - (i + 1);
+        for (; j < rowSpanCount; j++) {
+            rowSpans[j - removed] = rowSpans[j];
+        }
+        rowSpanCount -= removed;
+    }
+}
+
+// Appends to the active list in priority order; entries of equal priority stay in activation order.
+static void activateDrawListEntry(DrawListEntry* dle)
+{
+    uint8_t priority = dle->flags & DLE_PRIORITY_MASK;
+
+    // The tail points at the last entry's next field, which is its first member
+    if (activeDLETail == &activeDLEs || (((DrawListEntry*) activeDLETail)->flags & DLE_PRIORITY_MASK) <= priority) {
+        *activeDLETail = DLE_OFFSET(dle);
+        activeDLETail = &dle->next;
     } else {
-        return NULL;
+        uint16_t* lastDle = &activeDLEs;
+
+        while ((DLE_PTR(*lastDle)->flags & DLE_PRIORITY_MASK) <= priority) {
+            lastDle = &DLE_PTR(*lastDle)->next;
+        }
+
+        dle->next = *lastDle;
+        *lastDle = DLE_OFFSET(dle);
+    }
+}
+
+// Gets the horizontal extent and height of an entry
+static uint16_t getDrawListEntryExtent(const DrawListEntry* dle, uint16_t* x, uint16_t* width)
+{
+    *x = dle->x;
+
+    if (dle->flags & DLE_CLIPPED) {
+        const ClipWindow* window = getClipWindow(dle);
+        *width = window->width;
+        return window->height;
+    }
+
+    switch (dle->flags & DLE_TYPE_MASK) {
+        case DLE_TYPE_VLINE: {
+            *width = 1;
+            return ((const LineDLE*) dle)->length;
+        }
+        case DLE_TYPE_HLINE: {
+            *width = ((const LineDLE*) dle)->length;
+            return 1;
+        }
+        case DLE_TYPE_RECT: {
+            const RectDLE* rect = (const RectDLE*) dle;
+            *width = rect->width;
+            return rect->height;
+        }
+        case DLE_TYPE_TXTCH: {
+            const Glyph* glyph = getGlyph((const GlyphDLE*) dle);
+            *width = glyph->width;
+            return glyph->height;
+        }
+        case DLE_TYPE_IMAGE: {
+            const Image* image = getImage((const ImageDLE*) dle);
+            *width = image->width;
+            return image->height;
+        }
+        case DLE_TYPE_BOX: {
+            const BoxDLE* box = (const BoxDLE*) dle;
+            *width = box->width;
+            return box->height;
+        }
+        case DLE_TYPE_CIRCLE: {
+            *width = ((const CircleDLE*) dle)->radius * 2;
+            return *width;
+        }
+        case DLE_TYPE_VGRAD:
+        case DLE_TYPE_HGRAD: {
+            const GradientDLE* gradient = (const GradientDLE*) dle;
+            *width = gradient->width;
+            return gradient->height;
+        }
+        default: {
+            *width = 0;
+            return 0;
+        }
+    }
+}
+
+// Gets the left edge of an entry's primitive, which for a clipped entry may be off screen, and
+// the row of the primitive drawn on scanline y
+static int16_t getDrawListEntryOrigin(const DrawListEntry* dle, uint16_t y, uint16_t* row)
+{
+    *row = y - dle->y;
+
+    if (dle->flags & DLE_CLIPPED) {
+        const ClipWindow* window = getClipWindow(dle);
+        *row += window->top;
+        return dle->x - window->left;
+    }
+
+    return dle->x;
+}
+
+// Queues a filled in entry to be activated at its first scanline and adds it to the damage
+static void addDrawListEntry(DrawListEntry* dle)
+{
+    uint16_t x, width;
+    uint16_t height = getDrawListEntryExtent(dle, &x, &width);
+
+    insertPendingDrawListEntry(dle);
+    updateDrawListBounds(x, dle->y, x + width, dle->y + height);
+}
+
+// Shrinks the current band to the scanlines whose entries fill about DRAWLIST_BAND_KEEP bytes, leaving
+// room for primitives still to be drawn in it, and discards the entries that lie wholly below it.
+// The scanlines dropped from the band are drawn in later passes, see rendererRenderDrawList().
+static void shrinkDrawListBand()
+{
+    size_t readEnd = drawListEnd;
+    uint16_t bandBytes[PENDING_BAND_COUNT];
+    int firstBand = bandMinY >> PENDING_BAND_SHIFT;
+    size_t keptBytes = 0;
+
+    memset(bandBytes, 0, sizeof(bandBytes));
+
+    for (size_t readPos = 0; readPos < readEnd; readPos += getDrawListEntrySize(DLE_PTR(readPos))) {
+        const DrawListEntry* dle = DLE_PTR(readPos);
+        bandBytes[MAX(dle->y, bandMinY) >> PENDING_BAND_SHIFT] += getDrawListEntrySize(dle);
+    }
+
+    for (int i = firstBand; i < PENDING_BAND_COUNT; i++) {
+        keptBytes += bandBytes[i];
+
+        if (keptBytes > DRAWLIST_BAND_KEEP) {
+            if (i > firstBand) {
+                bandMaxY = i << PENDING_BAND_SHIFT;
+            } else {
+                bandMaxY = bandMinY + ((bandMaxY - bandMinY) >> 1);
+            }
+            break;
+        }
+    }
+
+    for (int i = 0; i < PENDING_BAND_COUNT; i++) {
+        pendingBands[i].head = DLE_NULL;
+        pendingBands[i].tail = &pendingBands[i].head;
+    }
+
+    drawListEnd = 0;
+    damageRectCount = 0;
+    drawListMinX = SCREEN_WIDTH;
+    drawListMinY = SCREEN_HEIGHT;
+    drawListMaxX = 0;
+    drawListMaxY = 0;
+
+    if (drawListClearsBand) {
+        updateDrawListBounds(0, bandMinY, SCREEN_WIDTH, bandMaxY);
+    }
+
+    // Entries are kept in buffer order, which is the order they were drawn in
+    for (size_t readPos = 0; readPos < readEnd;) {
+        DrawListEntry* dle = DLE_PTR(readPos);
+        size_t size = getDrawListEntrySize(dle);
+
+        if (dle->y < bandMaxY) {
+            dle = memmove(DLE_PTR(drawListEnd), dle, size);
+            dle->next = DLE_NULL;
+            drawListEnd += size;
+
+            addDrawListEntry(dle);
+        }
+
+        readPos += size;
+    }
+}
+
+static void addOccluder(uint16_t x0, uint16_t x1, uint8_t priority, uint16_t minX, uint16_t maxX)
+{
+    if (occluderCount < OCCLUDER_COUNT) {
+        occluders[occluderCount].x0 = MAX(x0, minX);
+        occluders[occluderCount].x1 = MIN(x1, maxX);
+        occluders[occluderCount].priority = priority;
+        occluderCount++;
+    }
+}
+
+static uint16_t getGlyphRowBytes(const Glyph* glyph)
+{
+    return glyph->format == GLYPH_FORMAT_1BPP ? (glyph->width + 7) >> 3 : glyph->width;
+}
+
+// Draws count pixels of a packed 1bpp glyph row from pixel start onwards. Each byte load covers 8
+// pixels and bytes without ink are skipped, as are trailing pixels once no ink remains in a byte.
+static void drawGlyphSpan1bpp(uint16_t* pixPtr, const uint8_t* rowData, uint16_t start, uint16_t count, uint16_t colour)
+{
+    const uint8_t* bits = rowData + (start >> 3);
+    uint8_t byte = *bits++ << (start & 7);
+    uint16_t available = 8 - (start & 7);
+
+    while (count > 0) {
+        uint16_t pixels = MIN(available, count);
+        uint8_t ink = byte & (uint8_t) (0xff << (8 - pixels));
+
+        if (ink) {
+            pixelKernelFillMasked(pixPtr, ink, colour);
+        }
+
+        count -= pixels;
+        pixPtr += pixels;
+
+        if (count > 0) {
+            byte = *bits++;
+            available = 8;
+        }
+    }
+}
+
+static uint8_t getImageBpp(uint8_t format)
+{
+    switch (format) {
+        case IMAGE_FORMAT_1BPP:
+            return 1;
+        case IMAGE_FORMAT_2BPP:
+            return 2;
+        case IMAGE_FORMAT_4BPP:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+// Draws count pixels of a packed 1, 2 or 4bpp image row from pixel start onwards. Each byte load
+// covers several pixels and wholly transparent bytes are skipped, as are trailing pixels once
+// only transparent ones remain in a byte.
+static void drawImageSpanPacked(uint16_t* pixPtr, const uint8_t* rowData, uint16_t start, uint16_t count, const uint16_t* palette, uint8_t bpp)
+{
+    uint16_t bit = start * bpp;
+    const uint8_t* packed = rowData + (bit >> 3);
+    uint8_t byte = *packed++ << (bit & 7);
+    uint16_t available = (8 - (bit & 7)) / bpp;
+    uint8_t shift = 8 - bpp;
+
+    while (count > 0) {
+        uint16_t pixels = MIN(available, count);
+        uint8_t ink = byte & (uint8_t) (0xff << (8 - pixels * bpp));
+        uint16_t* inkPtr = pixPtr;
+
+        if (bpp == 1) {
+            // Every set bit is the one opaque colour
+            if (ink) {
+                pixelKernelFillMasked(pixPtr, ink, palette[1]);
+            }
+        } else {
+            while (ink) {
+                uint8_t pix = ink >> shift;
+                if (pix) {
+                    *inkPtr = palette[pix];
+                }
+                ink <<= bpp;
+                inkPtr++;
+            }
+        }
+
+        count -= pixels;
+        pixPtr += pixels;
+
+        if (count > 0) {
+            byte = *packed++;
+            available = 8 / bpp;
+        }
+    }
+}
+
+// Draws count pixels of a run-length encoded image row from pixel start onwards. Transparent runs
+// take one step however long they are, as do runs wholly before the span.
+static void drawImageSpanRle(uint16_t* pixPtr, const uint8_t* run, uint16_t start, uint16_t count, const uint16_t* palette)
+{
+    uint16_t end = start + count;
+    uint16_t x = 0;
+
+    while (x < end) {
+        uint8_t header = *run++;
+        uint16_t length = (header & IMAGE_RUN_LENGTH_MASK) + 1;
+
+        if (header & IMAGE_RUN_OPAQUE_MASK) {
+            uint16_t runStart = MAX(x, start);
+            uint16_t runEnd = MIN(x + length, end);
+            const uint8_t* imagePix = run + runStart - x;
+            uint16_t* runPtr = pixPtr + runStart - start;
+
+            if (runStart < runEnd) {
+                pixelKernelExpand(runPtr, imagePix, runEnd - runStart, palette);
+            }
+
+            run += length;
+        }
+
+        x += length;
+    }
+}
+
+static const uint8_t* skipImageRowRle(const uint8_t* run, uint16_t width)
+{
+    while (width > 0) {
+        uint8_t header = *run++;
+        uint16_t length = (header & IMAGE_RUN_LENGTH_MASK) + 1;
+
+        if (header & IMAGE_RUN_OPAQUE_MASK) {
+            run += length;
+        }
+
+        width -= length;
+    }
+
+    return run;
+}
+
+// Checks whether pixels [start, start + count) of the image's current row are all opaque
+static int isImageRowOpaque(const ImageDLE* image, uint16_t start, uint16_t count)
+{
+    const Image* imageData = getImage(image);
+    uint8_t format = imageData->format;
+    const uint8_t* pixels = getImageRow(image, imageData);
+    uint16_t end = start + count;
+
+    if (format == IMAGE_FORMAT_8BPP) {
+        return !memchr(pixels + start, 0, count);
+    }
+
+    if (format != IMAGE_FORMAT_8BPP_RLE) {
+        uint8_t bpp = getImageBpp(format);
+        uint8_t mask = (1 << bpp) - 1;
+
+        for (uint16_t bit = start * bpp; bit < end * bpp; bit += bpp) {
+            if (!((pixels[bit >> 3] >> (8 - bpp - (bit & 7))) & mask)) {
+                return 0;
+            }
+        }
+
+        return 1;
+    }
+
+    const uint8_t* run = pixels;
+    uint16_t x = 0;
+
+    while (x < end) {
+        uint8_t header = *run++;
+        uint16_t length = (header & IMAGE_RUN_LENGTH_MASK) + 1;
+
+        if (!(header & IMAGE_RUN_OPAQUE_MASK)) {
+            if (x + length > start) {
+                return 0;
+            }
+        } else {
+            run += length;
+        }
+
+        x += length;
+    }
+
+    return 1;
+}
+
+// Gets the half width of row [0, 2 * radius) of a circle: the number of pixels either side of its
+// centre whose centres lie inside it. The last half width found is kept in *halfWidth and stepped
+// from, so going down the rows takes a step or two per row rather than a square root.
+static uint8_t getCircleHalfWidth(uint8_t* halfWidth, uint8_t radius, uint16_t row)
+{
+    int32_t dy = 2 * row + 1 - 2 * radius;
+    int32_t limit = 4 * radius * radius - dy * dy;
+    int32_t half = *halfWidth;
+
+    while (half < radius && (2 * half + 1) * (2 * half + 1) <= limit) {
+        half++;
+    }
+
+    while (half > 0 && (2 * half - 1) * (2 * half - 1) > limit) {
+        half--;
+    }
+
+    *halfWidth = half;
+    return half;
+}
+
+// Gets how far a row of a rectangle with rounded corners is inset from each side
+static uint16_t getCornerInset(uint8_t* halfWidth, uint8_t radius, uint16_t row, uint16_t height)
+{
+    if (row < radius) {
+        return radius - getCircleHalfWidth(halfWidth, radius, row);
+    } else if (row >= height - radius) {
+        return radius - getCircleHalfWidth(halfWidth, radius, row + 2 * radius - height);
+    }
+
+    return 0;
+}
+
+// Gets a box's row as offsets from its left edge: [*x0, *x1) is drawn, and [*fillX0, *fillX1)
+// of that is filled, the rest being border
+static void getBoxRow(BoxDLE* box, uint16_t row, uint16_t* x0, uint16_t* x1, uint16_t* fillX0, uint16_t* fillX1)
+{
+    uint16_t inset = getCornerInset(&box->outerHalfWidth, box->radius, row, box->height);
+
+    *x0 = inset;
+    *x1 = box->width - inset;
+
+    if (row < box->border || row >= box->height - box->border) {
+        *fillX0 = *x1;
+        *fillX1 = *x1;
+    } else {
+        uint8_t innerRadius = box->radius > box->border ? box->radius - box->border : 0;
+        uint16_t innerInset = box->border + getCornerInset(&box->innerHalfWidth, innerRadius, row - box->border, box->height - 2 * box->border);
+
+        *fillX0 = MAX(innerInset, *x0);
+        *fillX1 = MAX(box->width - innerInset, *fillX0);
+    }
+}
+
+// Adds the part of [x0, x1) within [clipX0, clipX1) to a list of spans, returning the new count
+static int addClippedRowSpan(RowSpan* spans, int count, int x0, int x1, uint16_t clipX0, uint16_t clipX1)
+{
+    x0 = MAX(x0, clipX0);
+    x1 = MIN(x1, clipX1);
+
+    if (x0 < x1) {
+        spans[count].x0 = x0;
+        spans[count].x1 = x1;
+        count++;
+    }
+
+    return count;
+}
+
+// Gets the parts of [clipX0, clipX1) a circle with left edge x covers on a row; up to one either
+// side of its centre. Returns the number of spans.
+static int getCircleRowSpans(CircleDLE* circle, uint16_t row, int16_t x, uint16_t clipX0, uint16_t clipX1, RowSpan* spans)
+{
+    int centreX = x + circle->radius;
+    uint8_t radius = circle->radius;
+    uint8_t innerRadius = circle->innerRadius;
+    uint16_t innerRow = row - (radius - innerRadius);
+    uint8_t outerHalf = getCircleHalfWidth(&circle->outerHalfWidth, radius, row);
+    uint8_t innerHalf = 0;
+    int top = row < radius;
+    int count = 0;
+
+    if (innerRadius && row >= radius - innerRadius && innerRow < 2 * innerRadius) {
+        innerHalf = getCircleHalfWidth(&circle->innerHalfWidth, innerRadius, innerRow);
+    }
+
+    if (outerHalf > innerHalf) {
+        if (circle->quadrants & (top ? RENDERER_QUADRANT_TOP_LEFT : RENDERER_QUADRANT_BOTTOM_LEFT)) {
+            count = addClippedRowSpan(spans, count, centreX - outerHalf, centreX - innerHalf, clipX0, clipX1);
+        }
+
+        if (circle->quadrants & (top ? RENDERER_QUADRANT_TOP_RIGHT : RENDERER_QUADRANT_BOTTOM_RIGHT)) {
+            count = addClippedRowSpan(spans, count, centreX + innerHalf, centreX + outerHalf, clipX0, clipX1);
+        }
+    }
+
+    return count;
+}
+
+// Gets the opaque parts of [clipX0, clipX1) on a row of a box, circle or gradient with left edge x.
+// Returns the number of spans.
+static int getShapeRowSpans(DrawListEntry* dle, uint16_t row, int16_t x, uint16_t clipX0, uint16_t clipX1, RowSpan* spans)
+{
+    switch (dle->flags & DLE_TYPE_MASK) {
+        case DLE_TYPE_BOX: {
+            uint16_t x0, x1, fillX0, fillX1;
+            getBoxRow((BoxDLE*) dle, row, &x0, &x1, &fillX0, &fillX1);
+            return addClippedRowSpan(spans, 0, x + x0, x + x1, clipX0, clipX1);
+        }
+        case DLE_TYPE_CIRCLE: {
+            return getCircleRowSpans((CircleDLE*) dle, row, x, clipX0, clipX1, spans);
+        }
+        default: {
+            return addClippedRowSpan(spans, 0, x, x + ((const GradientDLE*) dle)->width, clipX0, clipX1);
+        }
+    }
+}
+
+// Fills the part of [x0, x1) within [clipX0, clipX1)
+static void fillClippedPixels(int x0, int x1, uint16_t clipX0, uint16_t clipX1, uint16_t minX, uint16_t colour)
+{
+    x0 = MAX(x0, clipX0);
+    x1 = MIN(x1, clipX1);
+
+    if (x0 < x1) {
+        pixelKernelFill(pixelBuffer + x0 - minX, x1 - x0, colour);
+    }
+}
+
+// Gets a gradient's channels at the given row or column, in 1/256ths of a level, rounded
+static void getGradientChannels(const GradientDLE* gradient, uint16_t position, int32_t* channels)
+{
+    channels[0] = ((gradient->colour >> 11) << 8) + 128 + position * gradient->steps[0];
+    channels[1] = (((gradient->colour >> 5) & 0x3f) << 8) + 128 + position * gradient->steps[1];
+    channels[2] = ((gradient->colour & 0x1f) << 8) + 128 + position * gradient->steps[2];
+}
+
+static uint16_t packGradientColour(const int32_t* channels)
+{
+    return ((channels[0] >> 8) << 11) | ((channels[1] >> 8) << 5) | (channels[2] >> 8);
+}
+
+// Draws count pixels of a horizontal gradient from column start onwards
+static void drawGradientSpan(uint16_t* pixPtr, const GradientDLE* gradient, uint16_t start, uint16_t count)
+{
+    int32_t channels[3];
+
+    getGradientChannels(gradient, start, channels);
+
+    while (count-- > 0) {
+        *pixPtr++ = packGradientColour(channels);
+        channels[0] += gradient->steps[0];
+        channels[1] += gradient->steps[1];
+        channels[2] += gradient->steps[2];
+    }
+}
+
+// Draws the part [x0, x1) of a row of an entry's primitive, where x is the primitive's left edge
+static void drawDrawListEntrySpan(DrawListEntry* dle, int16_t x, uint16_t row, uint16_t x0, uint16_t x1, uint16_t minX)
+{
+    uint16_t* pixPtr = pixelBuffer + x0 - minX;
+    uint16_t width = x1 - x0;
+
+    PROFILE_COUNT(pixelWrites, width);
+
+    switch (dle->flags & DLE_TYPE_MASK) {
+        case DLE_TYPE_VLINE:
+        case DLE_TYPE_HLINE: {
+            //PROFILE_ENTER(hline);
+            pixelKernelFill(pixPtr, width, ((LineDLE*) dle)->colour);
+            //PROFILE_EXIT(hline);
+            break;
+        }
+        case DLE_TYPE_RECT: {
+            //PROFILE_ENTER(rect);
+            pixelKernelFill(pixPtr, width, ((RectDLE*) dle)->colour);
+            //PROFILE_EXIT(rect);
+            break;
+        }
+        case DLE_TYPE_TXTCH: {
+            //PROFILE_ENTER(text);
+            GlyphDLE* textChar = (GlyphDLE*) dle;
+            const Glyph* glyph = getGlyph(textChar);
+            const uint8_t* rowData = glyph->data + row * getGlyphRowBytes(glyph);
+            if (glyph->format == GLYPH_FORMAT_1BPP) {
+                drawGlyphSpan1bpp(pixPtr, rowData, x0 - x, width, textChar->colour);
+            } else {
+                pixelKernelFillKeyed(pixPtr, rowData + x0 - x, width, textChar->colour);
+            }
+            //PROFILE_EXIT(text);
+            break;
+        }
+        case DLE_TYPE_IMAGE: {
+            PROFILE_ENTER(image);
+            const Image* image = getImage((ImageDLE*) dle);
+            const uint16_t* imagePal = (const uint16_t*) GET_FLASH_PTR(image->paletteOffset);
+            const uint8_t* rowData = getImageRow((ImageDLE*) dle, image);
+
+            if (image->format == IMAGE_FORMAT_8BPP_RLE) {
+                drawImageSpanRle(pixPtr, rowData, x0 - x, width, imagePal);
+            } else if (image->format != IMAGE_FORMAT_8BPP) {
+                drawImageSpanPacked(pixPtr, rowData, x0 - x, width, imagePal, getImageBpp(image->format));
+            } else {
+                pixelKernelExpandKeyed(pixPtr, rowData + x0 - x, width, imagePal);
+            }
+            PROFILE_EXIT(image);
+            break;
+        }
+        case DLE_TYPE_BOX: {
+            PROFILE_ENTER(shape);
+            BoxDLE* box = (BoxDLE*) dle;
+            uint16_t boxX0, boxX1, fillX0, fillX1;
+            getBoxRow(box, row, &boxX0, &boxX1, &fillX0, &fillX1);
+            fillClippedPixels(x + boxX0, x + fillX0, x0, x1, minX, box->borderColour);
+            fillClippedPixels(x + fillX0, x + fillX1, x0, x1, minX, box->colour);
+            fillClippedPixels(x + fillX1, x + boxX1, x0, x1, minX, box->borderColour);
+            PROFILE_EXIT(shape);
+            break;
+        }
+        case DLE_TYPE_CIRCLE: {
+            PROFILE_ENTER(shape);
+            RowSpan spans[2];
+            int count = getCircleRowSpans((CircleDLE*) dle, row, x, x0, x1, spans);
+            for (int i = 0; i < count; i++) {
+                pixelKernelFill(pixelBuffer + spans[i].x0 - minX, spans[i].x1 - spans[i].x0, ((CircleDLE*) dle)->colour);
+            }
+            PROFILE_EXIT(shape);
+            break;
+        }
+        case DLE_TYPE_VGRAD: {
+            PROFILE_ENTER(shape);
+            int32_t channels[3];
+            getGradientChannels((GradientDLE*) dle, row, channels);
+            pixelKernelFill(pixPtr, width, packGradientColour(channels));
+            PROFILE_EXIT(shape);
+            break;
+        }
+        case DLE_TYPE_HGRAD: {
+            PROFILE_ENTER(shape);
+            drawGradientSpan(pixPtr, (GradientDLE*) dle, x0 - x, width);
+            PROFILE_EXIT(shape);
+            break;
+        }
+        default: {
+            break;
+        }
     }
 }
 
-void insertPendingDrawListEntry(DrawListEntry* dle)
+// Draws the parts of [x0, x1) not hidden by an occluder of higher priority
+static void drawVisibleSpans(DrawListEntry* dle, int16_t x, uint16_t row, uint16_t x0, uint16_t x1, uint16_t minX)
 {
-    if (pendingDLEs == NULL) {
-        *pendingDLETail = dle;
-        pendingDLETail = &dle->next;
-    } else {
-        DrawListEntry* candidateDLE = pendingDLEs;
-        DrawListEntry** candidateDLELink = &pendingDLEs;
-
-        while (candidateDLE && dle->y >= candidateDLE->y) {
-            candidateDLELink = &candidateDLE->next;
-            candidateDLE = candidateDLE->next;
+    uint8_t priority = dle->flags & DLE_PRIORITY_MASK;
+
+    while (x0 < x1) {
+        uint16_t visibleEnd = x1;
+        int hidden = 0;
+
+        for (int i = 0; i < occluderCount; i++) {
+            const Occluder* occluder = occluders + i;
+
+            if (occluder->priority > priority && occluder->x1 > x0) {
+                if (occluder->x0 <= x0) {
+                    x0 = occluder->x1;
+                    hidden = 1;
+                    break;
+                } else if (occluder->x0 < visibleEnd) {
+                    visibleEnd = occluder->x0;
+                }
+            }
         }
 
-        *candidateDLELink = dle;
-        dle->next = candidateDLE;
-
-        if (!candidateDLE) {
-            pendingDLETail = &dle->next;
+        if (!hidden) {
+            drawDrawListEntrySpan(dle, x, row, x0, visibleEnd, minX);
+            x0 = visibleEnd;
         }
     }
 }
 
-static void updateDrawListBounds(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+// Moves image entries on by a number of rows, once each scanline has been drawn and to skip the
+// rows of an entry clipped by the top of the band. Other entries find their row from the scanline.
+static void advanceDrawListEntryRows(DrawListEntry* dle, uint16_t rows)
 {
-    if (x0 > x1) {
-        SWAPNUM(x0, x1);
-    }
-
-    if (y0 > y1) {
-        SWAPNUM(y0, y1);
-    }
-
-    y0 = MAX(y0, 0);
-    y1 = MIN(y1, SCREEN_HEIGHT);
-    x0 = MAX(x0, 0);
-    x1 = MIN(x1, SCREEN_WIDTH);
-
-    if (x0 < drawListMinX) {
-        drawListMinX = x0;
-    }
-
-    if (x1 > drawListMaxX) {
-        drawListMaxX = x1;
-    }
-
-    if (y0 < drawListMinY) {
-        drawListMinY = y0;
-    }
-
-    if (y1 > drawListMaxY) {
-        drawListMaxY = y1;
+    if ((dle->flags & DLE_TYPE_MASK) == DLE_TYPE_IMAGE) {
+        ImageDLE* imageDle = (ImageDLE*) dle;
+        const Image* image = getImage(imageDle);
+
+        if (image->format == IMAGE_FORMAT_8BPP_RLE) {
+            const uint8_t* pixels = (const uint8_t*) GET_FLASH_PTR(image->pixelsOffset);
+            const uint8_t* run = pixels + imageDle->row;
+            while (rows--) {
+                run = skipImageRowRle(run, image->width);
+            }
+            imageDle->row = run - pixels;
+        } else {
+            imageDle->row += rows * ((image->width * getImageBpp(image->format) + 7) >> 3);
+        }
     }
+}
 
-    for (int y = y0; y < y1; y++) {
-        if (x0 < rowMinX[y]) {
-            rowMinX[y] = x0;
+// Gets the colour of a primitive that fills every pixel of its row, if it is of a kind that does
+static int getSolidRowColour(DrawListEntry* dle, uint16_t row, uint16_t* colour)
+{
+    switch (dle->flags & DLE_TYPE_MASK) {
+        case DLE_TYPE_VLINE:
+        case DLE_TYPE_HLINE: {
+            *colour = ((LineDLE*) dle)->colour;
+            return 1;
         }
-
-        if (x1 > rowMaxX[y]) {
-            rowMaxX[y] = x1;
+        case DLE_TYPE_RECT: {
+            *colour = ((RectDLE*) dle)->colour;
+            return 1;
+        }
+        case DLE_TYPE_VGRAD: {
+            int32_t channels[3];
+            getGradientChannels((GradientDLE*) dle, row, channels);
+            *colour = packGradientColour(channels);
+            return 1;
+        }
+        default: {
+            return 0;
         }
     }
 }
 
-static void renderScanLine(uint16_t y)
+// Renders [minX, maxX) of a scanline into the pixel buffer. A scanline of a single colour, with no
+// primitives or with the one drawn last filling it, is not rendered: its colour is returned in
+// fillColour for the LCD to be sent a run, and the function returns non-zero.
+static int renderScanLine(uint16_t y, uint16_t minX, uint16_t maxX, uint16_t* fillColour)
 {
     //PROFILE_ENTER(scanline);
 
-    size_t undrawnCount = 0;
-
-    DrawListEntry** lastDle = &pendingDLEs;
-    DrawListEntry* dle = pendingDLEs;
+    PendingBand* band = pendingBands + (y >> PENDING_BAND_SHIFT);
+    uint16_t* lastDle = &band->head;
+    uint16_t dleOffset = band->head;
+    DrawListEntry* dle;
 
     //PROFILE_ENTER(activationCheck);
-    while (dle && y == dle->y) {
-        DrawListEntry* nextDle = dle->next;
+    while (dleOffset != DLE_NULL) {
+        dle = DLE_PTR(dleOffset);
+        uint16_t nextDle = dle->next;
 
-        if (y == dle->y) {
+        if (dle->y <= y) {
             *lastDle = nextDle;
-            dle->next = NULL;
-            *activeDLETail = dle;
-            activeDLETail = &dle->next;
-        }
-
-        if (dle->next == nextDle) {
+            dle->next = DLE_NULL;
+            if (dle->y < y) {
+                advanceDrawListEntryRows(dle, y - dle->y);
+            }
+            activateDrawListEntry(dle);
+        } else {
             lastDle = &dle->next;
         }
-        dle = nextDle;
-    }
-    //PROFILE_EXIT(activationCheck);
-
-    lastDle = &activeDLEs;
-    dle = activeDLEs;
-
-    uint16_t minX = drawListMinX;
-
-    int fillWidth = rowMinX[y] - drawListMinX;
-    uint16_t* fillPtr = pixelBuffer;
-
-    if (fillWidth >= 2) {
-        uint32_t fillDuo = 0;
-        uint32_t* fillPtrDuo = (uint32_t*) fillPtr;
-        while (fillWidth > 3) {
-            *(fillPtrDuo++) = fillDuo;
-            *(fillPtrDuo++) = fillDuo;
-            fillWidth -= 4;
-        }
-        while (fillWidth > 1) {
-            *(fillPtrDuo++) = fillDuo;
-            fillWidth -= 2;
-        }
-        fillPtr = (uint16_t*) fillPtrDuo;
-    }
 
-    while (fillWidth > 0) {
-        *fillPtr++ = 0;
-        fillWidth--;
+        dleOffset = nextDle;
     }
 
-    //PROFILE_ENTER(primitives);
-    while (dle) {
-        DrawListEntry* nextDle = dle->next;
+    band->tail = lastDle;
+    //PROFILE_EXIT(activationCheck);
 
-        switch (dle->flags & DLE_TYPE_MASK) {
-            case DLE_TYPE_VLINE: {
-                //PROFILE_ENTER(vline);
-                LineDLE* vLine = (LineDLE*) dle;
-                if (y == dle->y + vLine->length) {
-                    *lastDle = nextDle;
-                    dle->next = dle;
-                } else {
-                    pixelBuffer[vLine->x - minX] = vLine->colour;
+    // Retire DLEs that ended on the previous scanline, and gather the spans of this one covered by
+    // opaque primitives; glyphs and images have transparent pixels so do not count as coverage.
+    // Opaque rects, image rows and shape spans above the lowest active priority also occlude lower
+    // primitives.
+    rowSpanCount = 0;
+    occluderCount = 0;
+    lastDle = &activeDLEs;
+    dleOffset = activeDLEs;
+
+    uint8_t lowestPriority = activeDLEs != DLE_NULL ? DLE_PTR(activeDLEs)->flags & DLE_PRIORITY_MASK : 0;
+    DrawListEntry* topDle = NULL;
+
+    while (dleOffset != DLE_NULL) {
+        dle = DLE_PTR(dleOffset);
+        uint16_t x, width, row;
+        uint16_t height = getDrawListEntryExtent(dle, &x, &width);
+        int16_t originX = getDrawListEntryOrigin(dle, y, &row);
+        uint8_t type = dle->flags & DLE_TYPE_MASK;
+        uint8_t priority = dle->flags & DLE_PRIORITY_MASK;
+
+        if (y == dle->y + height) {
+            *lastDle = dle->next;
+        } else {
+            if (type == DLE_TYPE_VLINE || type == DLE_TYPE_HLINE || type == DLE_TYPE_RECT) {
+                addRowSpan(x, x + width, minX, maxX);
+
+                if (priority > lowestPriority && type != DLE_TYPE_VLINE) {
+                    addOccluder(x, x + width, priority, minX, maxX);
                 }
-                //PROFILE_EXIT(vline);
-                break;
-            }
-            case DLE_TYPE_HLINE: {
-                //PROFILE_ENTER(hline);
-                LineDLE* hLine = (LineDLE*) dle;
-                for (uint16_t x = 0; x < hLine->length; x++) {
-                    pixelBuffer[hLine->x - minX + x] = hLine->colour;
+            } else if (type == DLE_TYPE_IMAGE && priority > lowestPriority) {
+                if (isImageRowOpaque((ImageDLE*) dle, x - originX, width)) {
+                    addOccluder(x, x + width, priority, minX, maxX);
                 }
-                *lastDle = nextDle;
-                dle->next = dle;
-                //PROFILE_EXIT(hline);
-                break;
-            }
-            case DLE_TYPE_RECT: {
-                //PROFILE_ENTER(rect);
-                RectDLE* rect = (RectDLE*) dle;
-                if (y == dle->y + rect->height) {
-                    *lastDle = nextDle;
-                    dle->next = dle;
-                } else {
-                    int width = rect->width;
-                    uint16_t* pixPtr = pixelBuffer + rect->x - minX;
-                    if (((uint32_t) pixPtr) & 3) {
-                        *pixPtr++ = rect->colour;
-                        width--;
-                    }
+            } else if (type >= DLE_TYPE_BOX) {
+                RowSpan spans[2];
+                int count = getShapeRowSpans(dle, row, originX, x, x + width, spans);
 
-                    if (width >= 2) {
-                        uint32_t pixDuo = (uint32_t) rect->colour | ((uint32_t) rect->colour << 16);
-                        uint32_t* pixPtrDuo = (uint32_t*) pixPtr;
-                        while (width > 3) {
-                            *(pixPtrDuo++) = pixDuo;
-                            *(pixPtrDuo++) = pixDuo;
-                            width -= 4;
-                        }
-                        while (width > 1) {
-                            *(pixPtrDuo++) = pixDuo;
-                            width -= 2;
-                        }
-                        pixPtr = (uint16_t*) pixPtrDuo;
-                    }
+                for (int i = 0; i < count; i++) {
+                    addRowSpan(spans[i].x0, spans[i].x1, minX, maxX);
 
-                    while (width--) {
-                        *pixPtr++ = rect->colour;
-                    }
-                }
-                //PROFILE_EXIT(rect);
-                break;
-            }
-            case DLE_TYPE_TXTCH: {
-                //PROFILE_ENTER(text);
-                GlyphDLE* textChar = (GlyphDLE*) dle;
-                if (y == dle->y + textChar->glyph->height) {
-                    *lastDle = nextDle;
-                    dle->next = dle;
-                } else {
-                    const uint8_t* charData = textChar->data;
-                    uint16_t* pixPtr = pixelBuffer + textChar->x - minX;
-                    uint16_t width = textChar->glyph->width;
-                    while (width-- > 0) {
-                        if (!(*charData)) {
-                            *pixPtr = textChar->colour;
-                        }
-                        charData++;
-                        pixPtr++;
-                    }
-                    textChar->data = charData;
-                }
-                //PROFILE_EXIT(text);
-                break;
-            }
-            case DLE_TYPE_IMAGE: {
-                //PROFILE_ENTER(image);
-                ImageDLE* image = (ImageDLE*) dle;
-                if (y == dle->y + image->image->height) {
-                    *lastDle = nextDle;
-                    dle->next = dle;
-                } else {
-                    const uint8_t* imagePix = image->pixels;
-                    const uint16_t* imagePal = image->palette;
-                    uint16_t* pixPtr = pixelBuffer + image->x - minX;
-                    uint16_t width = image->image->width;
-
-                    while (width-- > 0) {
-                        uint8_t pix = *imagePix++;
-                        if (pix) {
-                            *pixPtr++ = imagePal[pix];
-                        } else {
-                            pixPtr++;
-                        }
+                    if (priority > lowestPriority) {
+                        addOccluder(spans[i].x0, spans[i].x1, priority, minX, maxX);
                     }
-
-                    image->pixels = imagePix;
                 }
-                //PROFILE_EXIT(image);
-                break;
             }
-            default: {
-                break;
-            }
-        }
-
-        if (dle->next != dle) {
             lastDle = &dle->next;
-        } else if (nextDle == NULL) {
-            activeDLETail = lastDle;
+            topDle = dle;
         }
 
-        dle = nextDle;
+        dleOffset = dle->next;
     }
 
-    fillWidth = drawListMaxX - rowMaxX[y];
-    fillPtr = pixelBuffer + rowMaxX[y] - drawListMinX;
+    activeDLETail = lastDle;
+
+    // Primitives are drawn in list order, so the last one covers everything beneath it
+    int solid = 0;
 
-    if (((uint32_t) fillPtr) & 3) {
-        *fillPtr++ = 0;
-        fillWidth--;
+    if (!topDle) {
+        *fillColour = 0;
+        solid = 1;
+    } else {
+        uint16_t x, width, row;
+        getDrawListEntryExtent(topDle, &x, &width);
+        getDrawListEntryOrigin(topDle, y, &row);
+        solid = x <= minX && x + width >= maxX && getSolidRowColour(topDle, row, fillColour);
     }
 
-    if (fillWidth >= 2) {
-        uint32_t fillDuo = 0;
-        uint32_t* fillPtrDuo = (uint32_t*) fillPtr;
-        while (fillWidth > 3) {
-            *(fillPtrDuo++) = fillDuo;
-            *(fillPtrDuo++) = fillDuo;
-            fillWidth -= 4;
-        }
-        while (fillWidth > 1) {
-            *(fillPtrDuo++) = fillDuo;
-            fillWidth -= 2;
+    if (solid) {
+        for (dleOffset = activeDLEs; dleOffset != DLE_NULL; dleOffset = dle->next) {
+            dle = DLE_PTR(dleOffset);
+            advanceDrawListEntryRows(dle, 1);
         }
-        fillPtr = (uint16_t*) fillPtrDuo;
+
+        return 1;
+    }
+
+    // Clear only the gaps between covered spans
+    uint16_t fillX = minX;
+
+    for (int i = 0; i < rowSpanCount; i++) {
+        pixelKernelFill(pixelBuffer + fillX - minX, rowSpans[i].x0 - fillX, 0);
+        fillX = rowSpans[i].x1;
     }
 
-    while (fillWidth > 0) {
-        *fillPtr++ = 0;
-        fillWidth--;
+    pixelKernelFill(pixelBuffer + fillX - minX, maxX - fillX, 0);
+
+    PROFILE_ENTER(primitives);
+    for (dleOffset = activeDLEs; dleOffset != DLE_NULL; dleOffset = dle->next) {
+        uint16_t x, width, row;
+        dle = DLE_PTR(dleOffset);
+        getDrawListEntryExtent(dle, &x, &width);
+        int16_t originX = getDrawListEntryOrigin(dle, y, &row);
+
+        if (occluderCount) {
+            drawVisibleSpans(dle, originX, row, x, x + width, minX);
+        } else {
+            drawDrawListEntrySpan(dle, originX, row, x, x + width, minX);
+        }
+
+        advanceDrawListEntryRows(dle, 1);
     }
 
-    //PROFILE_EXIT(primitives);
+    PROFILE_EXIT(primitives);
     //PROFILE_EXIT(scanline);
+    return 0;
 }
 
 void rendererInit()
@@ -392,135 +1257,376 @@ void rendererInit()
 void rendererClearScreen()
 {
     tftStartBlit(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-    tftClear(SCREEN_WIDTH * SCREEN_HEIGHT);
+    tftFill(0, SCREEN_WIDTH * SCREEN_HEIGHT);
     tftEndBlit();
 }
 
-void rendererNewDrawList()
+void rendererStartScreenImage(ScreenImageStream* stream, const uint16_t* runs)
+{
+    stream->run = runs;
+    stream->remaining = 0;
+    stream->literal = 0;
+}
+
+// Sends rows [y0, y1) of a screen image, carrying on from where the stream last stopped. Literal
+// runs are sent straight from flash, and repeat runs as LCD fills.
+void rendererBlitScreenImage(ScreenImageStream* stream, uint16_t y0, uint16_t y1)
 {
-    activeDLEs = NULL;
+    ASSERTBRK(y0 < y1 && y1 <= SCREEN_HEIGHT);
+
+    uint32_t pixels = (uint32_t) (y1 - y0) * SCREEN_WIDTH;
+
+    PROFILE_ENTER(blit);
+    tftStartBlit(0, y0, SCREEN_WIDTH, y1 - y0);
+
+    while (pixels > 0) {
+        if (stream->remaining == 0) {
+            uint16_t header = *stream->run++;
+            stream->remaining = (header & SCREEN_IMAGE_RUN_LENGTH_MASK) + 1;
+            stream->literal = header & SCREEN_IMAGE_RUN_LITERAL_MASK;
+        }
+
+        uint16_t count = MIN(stream->remaining, pixels);
+
+        if (stream->literal) {
+            tftBlitAsync((uint16_t*) stream->run, count);
+            stream->run += count;
+        } else {
+            tftFill(*stream->run, count);
+
+            if (count == stream->remaining) {
+                stream->run++;
+            }
+        }
+
+        stream->remaining -= count;
+        pixels -= count;
+    }
+
+    tftEndBlit();
+    PROFILE_EXIT(blit);
+    PROFILE_COUNT(blitBytes, (uint32_t) (y1 - y0) * SCREEN_WIDTH * sizeof(uint16_t));
+    tftSetBacklight(1);
+}
+
+// Empties the draw list for a pass drawing scanlines y onwards
+static void beginDrawListBand(uint16_t y)
+{
+    activeDLEs = DLE_NULL;
     activeDLETail = &activeDLEs;
-    pendingDLEs = NULL;
-    pendingDLETail = &pendingDLEs;
+
+    for (int i = 0; i < PENDING_BAND_COUNT; i++) {
+        pendingBands[i].head = DLE_NULL;
+        pendingBands[i].tail = &pendingBands[i].head;
+    }
+
     drawListEnd = 0;
+    damageRectCount = 0;
+    drawPriority = 0;
+    clipDepth = 0;
+    clipRect.x0 = 0;
+    clipRect.y0 = 0;
+    clipRect.x1 = SCREEN_WIDTH;
+    clipRect.y1 = SCREEN_HEIGHT;
+    bandMinY = y;
+    bandMaxY = frameMaxY;
     drawListMinX = SCREEN_WIDTH;
     drawListMinY = SCREEN_HEIGHT;
     drawListMaxX = 0;
     drawListMaxY = 0;
 
-    memset(rowMinX, SCREEN_WIDTH, SCREEN_HEIGHT);
-    memset(rowMaxX, 0, SCREEN_HEIGHT);
+    if (drawListClearsBand) {
+        updateDrawListBounds(0, bandMinY, SCREEN_WIDTH, bandMaxY);
+    }
+}
+
+// Empties the draw list for a frame of the whole screen
+static void resetDrawList()
+{
+    frameMaxY = SCREEN_HEIGHT;
+    drawListClearsBand = 0;
+    beginDrawListBand(0);
+    drawListBands = 0;
+}
+
+void rendererNewDrawList()
+{
+    resetDrawList();
+    PROFILE_BEGIN;
+}
+
+// Starts a draw list rendering all of scanlines [y0, y1), clearing whatever they held before;
+// primitives outside them are dropped, so the whole screen can be drawn a strip at a time
+void rendererNewDrawListStrip(uint16_t y0, uint16_t y1)
+{
+    ASSERTBRK(y0 < y1 && y1 <= SCREEN_HEIGHT);
+
+    frameMaxY = y1;
+    drawListClearsBand = 1;
+    beginDrawListBand(y0);
+    drawListBands = 0;
     PROFILE_BEGIN;
 }
 
-void rendererDrawVLine(uint16_t x, uint16_t y, uint16_t length, uint16_t colour)
+void rendererSetDrawPriority(uint8_t priority)
 {
+    ASSERTBRK(priority <= RENDERER_PRIORITY_MAX);
+    drawPriority = priority & DLE_PRIORITY_MASK;
+}
+
+// Clips the primitives drawn until the matching rendererPopClip() to the given rectangle, within
+// any clip rectangle already pushed. Each draw list starts clipped only to the screen.
+void rendererPushClip(int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+    ASSERTBRK(clipDepth < CLIP_STACK_DEPTH);
+
+    ClipRect outer = clipRect;
+
+    clipStack[clipDepth++] = outer;
+    clipRect.x0 = MIN(MAX(x, outer.x0), outer.x1);
+    clipRect.y0 = MIN(MAX(y, outer.y0), outer.y1);
+    clipRect.x1 = MAX(MIN(x + width, outer.x1), clipRect.x0);
+    clipRect.y1 = MAX(MIN(y + height, outer.y1), clipRect.y0);
+}
+
+void rendererPopClip()
+{
+    ASSERTBRK(clipDepth > 0);
+
+    clipRect = clipStack[--clipDepth];
+}
+
+// Clips a primitive to the clip rectangle, finding the part of it left visible. Returns zero if
+// none of it is.
+static int clipPrimitive(int16_t x, int16_t y, uint16_t width, uint16_t height, ClipWindow* window)
+{
+    int x0 = MAX(x, clipRect.x0);
+    int y0 = MAX(y, clipRect.y0);
+    int x1 = MIN(x + width, clipRect.x1);
+    int y1 = MIN(y + height, clipRect.y1);
+
+    if (x0 >= x1 || y0 >= y1) {
+        return 0;
+    }
+
+    window->left = x0 - x;
+    window->top = y0 - y;
+    window->width = x1 - x0;
+    window->height = y1 - y0;
+    return 1;
+}
+
+// Allocates an entry for a primitive that can't be trimmed by adjusting its own fields. If it is
+// partly clipped the entry is followed by its clip window, and in either case is positioned at
+// the visible part. Returns NULL if none of the primitive is visible.
+static DrawListEntry* allocClippedDrawListEntry(size_t bytes, uint8_t type, int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+    ClipWindow window;
+
+    if (!clipPrimitive(x, y, width, height, &window)) {
+        return NULL;
+    }
+
+    int clipped = window.width != width || window.height != height;
+    DrawListEntry* dle = allocDrawListEntry(clipped ? bytes + sizeof(ClipWindow) : bytes, y + window.top, window.height);
+
+    if (dle) {
+        dle->flags = type | drawPriority | (clipped ? DLE_CLIPPED : 0);
+        dle->x = x + window.left;
+        dle->y = y + window.top;
+
+        if (clipped) {
+            *(ClipWindow*) ((uint8_t*) dle + bytes) = window;
+        }
+    }
+
+    return dle;
+}
+
+void rendererDrawVLine(int16_t x, int16_t y, uint16_t length, uint16_t colour)
+{
+    ClipWindow window;
+
     ASSERTBRK(length > 0);
-    ASSERTBRK(x >= 0 && x < SCREEN_WIDTH);
-    ASSERTBRK(y >= 0 && y < SCREEN_HEIGHT);
-    ASSERTBRK(y + length <= SCREEN_HEIGHT);
 
-    LineDLE* vLine = (LineDLE*) allocDrawListEntry(sizeof(LineDLE));
+    if (!clipPrimitive(x, y, 1, length, &window)) {
+        return;
+    }
+
+    LineDLE* vLine = (LineDLE*) allocDrawListEntry(sizeof(LineDLE), y + window.top, window.height);
 
     if (vLine) {
-        vLine->dle.flags = DLE_TYPE_VLINE;
-        vLine->dle.y = y;
-        vLine->x = x;
-        vLine->length = length;
+        vLine->dle.flags = DLE_TYPE_VLINE | drawPriority;
+        vLine->dle.x = x;
+        vLine->dle.y = y + window.top;
+        vLine->length = window.height;
         vLine->colour = colour;
 
-        insertPendingDrawListEntry(&vLine->dle);
-        updateDrawListBounds(x, y, x + 1, y + length);
+        addDrawListEntry(&vLine->dle);
     }
 }
 
 #include <assert.h>
 
-void rendererDrawHLine(uint16_t x, uint16_t y, uint16_t length, uint16_t colour)
+void rendererDrawHLine(int16_t x, int16_t y, uint16_t length, uint16_t colour)
 {
+    ClipWindow window;
+
     ASSERTBRK(length > 0);
-    ASSERTBRK(x >= 0 && x < SCREEN_WIDTH);
-    ASSERTBRK(y >= 0 && y < SCREEN_HEIGHT);
-    ASSERTBRK(x + length <= SCREEN_WIDTH);
 
-    LineDLE* vLine = (LineDLE*) allocDrawListEntry(sizeof(LineDLE));
+    if (!clipPrimitive(x, y, length, 1, &window)) {
+        return;
+    }
+
+    LineDLE* vLine = (LineDLE*) allocDrawListEntry(sizeof(LineDLE), y, 1);
 
     if (vLine) {
-        vLine->dle.flags = DLE_TYPE_HLINE;
+        vLine->dle.flags = DLE_TYPE_HLINE | drawPriority;
+        vLine->dle.x = x + window.left;
         vLine->dle.y = y;
-        vLine->x = x;
-        vLine->length = length;
+        vLine->length = window.width;
         vLine->colour = colour;
 
-        insertPendingDrawListEntry(&vLine->dle);
-        updateDrawListBounds(x, y, x + length, y + 1);
+        addDrawListEntry(&vLine->dle);
     }
 }
 
-void rendererDrawRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t colour)
+void rendererDrawRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour)
 {
+    ClipWindow window;
+
     ASSERTBRK(width > 0);
     ASSERTBRK(height > 0);
-    ASSERTBRK(x >= 0 && x < SCREEN_WIDTH);
-    ASSERTBRK(y >= 0 && y < SCREEN_HEIGHT);
-    ASSERTBRK(x + width <= SCREEN_WIDTH);
-    ASSERTBRK(y + height <= SCREEN_HEIGHT);
 
-    RectDLE* rect = (RectDLE*) allocDrawListEntry(sizeof(RectDLE));
+    if (!clipPrimitive(x, y, width, height, &window)) {
+        return;
+    }
+
+    RectDLE* rect = (RectDLE*) allocDrawListEntry(sizeof(RectDLE), y + window.top, window.height);
 
     if (rect) {
-        rect->dle.flags = DLE_TYPE_RECT;
-        rect->dle.y = y;
-        rect->x = x;
-        rect->width = width;
-        rect->height = height;
+        rect->dle.flags = DLE_TYPE_RECT | drawPriority;
+        rect->dle.x = x + window.left;
+        rect->dle.y = y + window.top;
+        rect->width = window.width;
+        rect->height = window.height;
         rect->colour = colour;
 
-        insertPendingDrawListEntry(&rect->dle);
-        updateDrawListBounds(x, y, x + width, y + height);
+        addDrawListEntry(&rect->dle);
     }
 }
 
-static const Glyph* findGlyph(char c, const Font* font)
+// Draws a box with corners of the given radius, filled with colour inside a border of the given width.
+// With no radius and a one pixel border this is the outline and fill of a button as a single entry.
+void rendererDrawBox(int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t radius, uint8_t border, uint16_t colour, uint16_t borderColour)
 {
-    const Glyph* glyph = NULL;
-    if (c >= font->chars[0].code && c <= font->chars[font->length - 1].code) {
+    ASSERTBRK(width > 0);
+    ASSERTBRK(height > 0);
+    ASSERTBRK(radius * 2 <= width && radius * 2 <= height);
+    ASSERTBRK(border * 2 <= width && border * 2 <= height);
+
+    BoxDLE* box = (BoxDLE*) allocClippedDrawListEntry(sizeof(BoxDLE), DLE_TYPE_BOX, x, y, width, height);
+
+    if (box) {
+        box->width = width;
+        box->height = height;
+        box->colour = colour;
+        box->borderColour = borderColour;
+        box->radius = radius;
+        box->border = border;
+        box->outerHalfWidth = 0;
+        box->innerHalfWidth = 0;
+
+        addDrawListEntry(&box->dle);
+    }
+}
 
-        for (int i = 0; i < font->length; i++) {
-            if (font->chars[i].code == c) {
-                glyph = font->chars[i].image;
-                break;
-            }
-            if (font->chars[i].code > c) {
-                break;
-            }
-        }
+void rendererDrawRoundedRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t radius, uint16_t colour)
+{
+    rendererDrawBox(x, y, width, height, radius, 0, colour, colour);
+}
+
+// Draws the quadrants of a ring between the two radii about centre (x, y), or of a filled circle
+// if the inner radius is zero
+void rendererDrawArc(int16_t x, int16_t y, uint8_t radius, uint8_t innerRadius, uint8_t quadrants, uint16_t colour)
+{
+    ASSERTBRK(radius > 0);
+    ASSERTBRK(innerRadius < radius);
+
+    CircleDLE* circle = (CircleDLE*) allocClippedDrawListEntry(sizeof(CircleDLE), DLE_TYPE_CIRCLE, x - radius, y - radius, radius * 2, radius * 2);
+
+    if (circle) {
+        circle->colour = colour;
+        circle->radius = radius;
+        circle->innerRadius = innerRadius;
+        circle->quadrants = quadrants;
+        circle->outerHalfWidth = 0;
+        circle->innerHalfWidth = 0;
+
+        addDrawListEntry(&circle->dle);
+    }
+}
+
+void rendererDrawCircle(int16_t x, int16_t y, uint8_t radius, uint16_t colour)
+{
+    rendererDrawArc(x, y, radius, 0, RENDERER_QUADRANTS_ALL, colour);
+}
+
+// Channel steps are found here, as the Cortex-M0+ has no divide instruction
+static void drawGradient(uint8_t type, int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour0, uint16_t colour1)
+{
+    ASSERTBRK(width > 0);
+    ASSERTBRK(height > 0);
+
+    GradientDLE* gradient = (GradientDLE*) allocClippedDrawListEntry(sizeof(GradientDLE), type, x, y, width, height);
+
+    if (gradient) {
+        int32_t steps = (type == DLE_TYPE_VGRAD ? height : width) - 1;
+
+        gradient->width = width;
+        gradient->height = height;
+        gradient->colour = colour0;
+        gradient->steps[0] = steps ? ((colour1 >> 11) - (colour0 >> 11)) * 256 / steps : 0;
+        gradient->steps[1] = steps ? (((colour1 >> 5) & 0x3f) - ((colour0 >> 5) & 0x3f)) * 256 / steps : 0;
+        gradient->steps[2] = steps ? ((colour1 & 0x1f) - (colour0 & 0x1f)) * 256 / steps : 0;
+
+        addDrawListEntry(&gradient->dle);
     }
+}
+
+// Fills a rectangle shading from colour0 on its top row to colour1 on its bottom row
+void rendererDrawVGradient(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour0, uint16_t colour1)
+{
+    drawGradient(DLE_TYPE_VGRAD, x, y, width, height, colour0, colour1);
+}
 
-    return glyph;
+// Fills a rectangle shading from colour0 on its left column to colour1 on its right column
+void rendererDrawHGradient(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour0, uint16_t colour1)
+{
+    drawGradient(DLE_TYPE_HGRAD, x, y, width, height, colour0, colour1);
+}
+
+static const Glyph* findGlyph(char c, const Font* font)
+{
+    uint8_t code = (uint8_t) c;
+    return code < FONT_CODE_LIMIT ? font->glyphs[code] : NULL;
 }
 
-void rendererDrawGlyph(const Glyph* glyph, uint16_t x, uint16_t y, uint16_t colour)
+void rendererDrawGlyph(const Glyph* glyph, int16_t x, int16_t y, uint16_t colour)
 {
-    ASSERTBRK(x >= 0 && x < SCREEN_WIDTH);
-    ASSERTBRK(y >= 0 && y < SCREEN_HEIGHT);
+    ASSERTBRK(GET_CODE_WORD_PTR(GET_CODE_WORD_INDEX(glyph)) == glyph);
 
-    GlyphDLE* textChar = (GlyphDLE*) allocDrawListEntry(sizeof(GlyphDLE));
+    GlyphDLE* textChar = (GlyphDLE*) allocClippedDrawListEntry(sizeof(GlyphDLE), DLE_TYPE_TXTCH, x, y, glyph->width, glyph->height);
 
     if (textChar) {
-        textChar->dle.flags = DLE_TYPE_TXTCH;
-        textChar->dle.y = y;
-        textChar->x = x;
         textChar->colour = colour;
-        textChar->glyph = glyph;
-        textChar->data = glyph->data;
+        textChar->glyph = GET_CODE_WORD_INDEX(glyph);
 
-        insertPendingDrawListEntry(&textChar->dle);
-        updateDrawListBounds(x, y, x + glyph->width, y + glyph->height);
+        addDrawListEntry(&textChar->dle);
     }
 }
 
-void rendererDrawChar(char c, uint16_t x, uint16_t y, const Font* font, uint16_t colour)
+void rendererDrawChar(char c, int16_t x, int16_t y, const Font* font, uint16_t colour)
 {
     const Glyph* glyph = findGlyph(c, font);
 
@@ -529,16 +1635,33 @@ void rendererDrawChar(char c, uint16_t x, uint16_t y, const Font* font, uint16_t
     }
 }
 
-void rendererDrawString(const char* s, uint16_t x, uint16_t y, const Font* font, uint16_t colour)
+// Gets the glyph drawn for a character, which is '*' for those the font lacks, or NULL
+const Glyph* rendererGetGlyph(char c, const Font* font)
+{
+    const Glyph* glyph = findGlyph(c, font);
+
+    return glyph ? glyph : findGlyph('*', font);
+}
+
+void rendererDrawString(const char* s, int16_t x, int16_t y, const Font* font, uint16_t colour)
 {
     char c;
 
     while ((c = *s++)) {
-        const Glyph* glyph = findGlyph(c, font);
+        const Glyph* glyph = rendererGetGlyph(c, font);
 
-        if (!glyph) {
-            glyph = findGlyph('*', font);
+        if (glyph) {
+            rendererDrawGlyph(glyph, x, y, colour);
+            x += glyph->width;
         }
+    }
+}
+
+// Draws text laid out by the config compiler, in which missing glyphs have already been replaced
+void rendererDrawTextRun(const TextRun* run, int16_t x, int16_t y, const Font* font, uint16_t colour)
+{
+    for (int i = 0; i < run->length; i++) {
+        const Glyph* glyph = font->glyphs[run->codes[i]];
 
         if (glyph) {
             rendererDrawGlyph(glyph, x, y, colour);
@@ -547,47 +1670,129 @@ void rendererDrawString(const char* s, uint16_t x, uint16_t y, const Font* font,
     }
 }
 
-void rendererDrawImage(const Image* i, uint16_t x, uint16_t y)
+void rendererDrawImage(const Image* i, int16_t x, int16_t y)
 {
     ASSERTBRK(i != NULL);
     ASSERTBRK(i->width > 0);
     ASSERTBRK(i->height > 0);
-    ASSERTBRK(x >= 0 && x < SCREEN_WIDTH);
-    ASSERTBRK(y >= 0 && y < SCREEN_HEIGHT);
-    ASSERTBRK(x + i->width <= SCREEN_WIDTH);
-    ASSERTBRK(y + i->height <= SCREEN_HEIGHT);
+    ASSERTBRK((GET_FLASH_OFFSET(i) & 3) == 0 && (GET_FLASH_OFFSET(i) >> 2) <= FLASH_WORD_INDEX_MAX);
 
-    ImageDLE* imageDle = (ImageDLE*) allocDrawListEntry(sizeof(ImageDLE));
+    ImageDLE* imageDle = (ImageDLE*) allocClippedDrawListEntry(sizeof(ImageDLE), DLE_TYPE_IMAGE, x, y, i->width, i->height);
 
     if (imageDle) {
-        imageDle->dle.flags = DLE_TYPE_IMAGE;
-        imageDle->dle.y = y;
-        imageDle->x = x;
-        imageDle->image = i;
-        imageDle->palette = (const uint16_t*) GET_FLASH_PTR(i->paletteOffset);
-        imageDle->pixels = (const uint8_t*) GET_FLASH_PTR(i->pixelsOffset);
+        imageDle->image = GET_FLASH_WORD_INDEX(i);
+        imageDle->row = 0;
+
+        // Rows clipped from the top are skipped once here, so the clip costs nothing per scanline
+        if (imageDle->dle.flags & DLE_CLIPPED) {
+            advanceDrawListEntryRows(&imageDle->dle, getClipWindow(&imageDle->dle)->top);
+        }
 
-        insertPendingDrawListEntry(&imageDle->dle);
-        updateDrawListBounds(x, y, x + i->width, y + i->height);
+        addDrawListEntry(&imageDle->dle);
     }
 }
 
-void rendererRenderDrawList()
+// Renders the current band. Returns nonzero if the draw list overflowed, in which case the band
+// was shrunk and the caller must draw the frame again to render the remaining scanlines. Once the
+// last band is rendered the draw list is left empty, so rendering it again sends nothing:
+//
+//	rendererNewDrawList();
+//	do {
+//		drawFrame();
+//	} while (rendererRenderDrawList());
+int rendererRenderDrawList()
 {
+    drawListBands++;
+
     if (drawListMaxX > drawListMinX) {
-        tftStartBlit(drawListMinX, drawListMinY, drawListMaxX - drawListMinX, drawListMaxY - drawListMinY);
         PROFILE_ENTER(render);
 
-        for (uint16_t y = drawListMinY; y < drawListMaxY; y++) {
-            renderScanLine(y);
-            PROFILE_ENTER(blit);
-            tftBlit(pixelBuffer, drawListMaxX - drawListMinX);
-            PROFILE_EXIT(blit);
+        // Blit rectangles in scanline order, as DLEs are activated and retired a scanline at a time
+        for (int i = 1; i < damageRectCount; i++) {
+            DamageRect rect = damageRects[i];
+            int j = i;
+
+            while (j > 0 && damageRects[j - 1].y0 > rect.y0) {
+                damageRects[j] = damageRects[j - 1];
+                j--;
+            }
+
+            damageRects[j] = rect;
+        }
+
+        uint32_t damagedPixels = 0;
+
+        for (int i = 0; i < damageRectCount; i++) {
+            const DamageRect* rect = damageRects + i;
+            uint16_t width = rect->x1 - rect->x0;
+
+            uint16_t fillColour = 0;
+            uint32_t fillPixels = 0;	// Solid scanlines of fillColour yet to be sent, as one run
+
+            tftStartBlit(rect->x0, rect->y0, width, rect->y1 - rect->y0);
+
+            for (uint16_t y = rect->y0; y < rect->y1; y++) {
+                uint16_t colour;
+
+                if (renderScanLine(y, rect->x0, rect->x1, &colour)) {
+                    if (fillPixels && colour != fillColour) {
+                        PROFILE_ENTER(blit);
+                        tftFill(fillColour, fillPixels);
+                        PROFILE_EXIT(blit);
+                        fillPixels = 0;
+                    }
+
+                    PROFILE_FILL_SIGNATURE(rect->x0, y, colour, width);
+                    PROFILE_COUNT(fillBytes, width * sizeof(uint16_t));
+                    fillColour = colour;
+                    fillPixels += width;
+                } else {
+                    PROFILE_SIGNATURE(rect->x0, y, pixelBuffer, width);
+                    PROFILE_ENTER(blit);
+                    if (fillPixels) {
+                        tftFill(fillColour, fillPixels);
+                        fillPixels = 0;
+                    }
+                    tftBlitAsync(pixelBuffer, width);
+                    PROFILE_EXIT(blit);
+
+                    // Render the next scanline while this one is sent
+                    pixelBuffer = (pixelBuffer == pixelBuffers[0]) ? pixelBuffers[1] : pixelBuffers[0];
+                }
+
+                PROFILE_COUNT(scanlines, 1);
+                PROFILE_COUNT(blitBytes, width * sizeof(uint16_t));
+            }
+
+            if (fillPixels) {
+                PROFILE_ENTER(blit);
+                tftFill(fillColour, fillPixels);
+                PROFILE_EXIT(blit);
+            }
+
+            tftEndBlit();
+
+            // Every DLE lies within one rectangle once clipped to the band, so all have been retired
+            // by its last scanline
+            activeDLEs = DLE_NULL;
+            activeDLETail = &activeDLEs;
+            damagedPixels += damageRectArea(rect);
         }
 
         PROFILE_EXIT(render);
-        tftEndBlit();
+        PROFILE_COUNT(damageRects, damageRectCount);
+        PROFILE_COUNT(damageSaved, (uint32_t) (drawListMaxX - drawListMinX) * (drawListMaxY - drawListMinY) - damagedPixels);
         tftSetBacklight(1);
+    }
+
+    if (bandMaxY < frameMaxY) {
+        beginDrawListBand(bandMaxY);
+        return 1;
+    }
+
+    // A frame drawn in more than one band overflowed, so must have drawn something
+    if (drawListBands > 1 || drawListMaxX > drawListMinX) {
+        PROFILE_COUNT(bands, drawListBands);
 
         PROFILE_ENTER(profileOuter);
         PROFILE_ENTER(profileInner);
@@ -606,9 +1811,20 @@ void rendererRenderDrawList()
         PROFILE_REPORT(rect);
         PROFILE_REPORT(text);
         PROFILE_REPORT(image);
+        PROFILE_REPORT(shape);
         PROFILE_REPORT(blit);
+        PROFILE_REPORT(dles);
+        PROFILE_REPORT(scanlines);
+        PROFILE_REPORT(blitBytes);
+        PROFILE_REPORT(damageRects);
+        PROFILE_REPORT(damageSaved);
+        PROFILE_REPORT(pixelWrites);
+        PROFILE_REPORT(bands);
         PROFILE_REPORT(profileOuter);
     }
+
+    resetDrawList();
+    return 0;
 }
 
 void rendererGetStringBounds(const char* s, const Font* font, uint16_t* width, uint16_t* height)
@@ -618,11 +1834,7 @@ void rendererGetStringBounds(const char* s, const Font* font, uint16_t* width, u
     *height = 0;
 
     while ((c = *s++)) {
-        const Glyph* glyph = findGlyph(c, font);
-
-        if (!glyph) {
-            glyph = findGlyph('*', font);
-        }
+        const Glyph* glyph = rendererGetGlyph(c, font);
 
         if (glyph) {
             *width += glyph->width;
@@ -631,9 +1843,8 @@ void rendererGetStringBounds(const char* s, const Font* font, uint16_t* width, u
     }
 }
 
-void rendererTest()
+void rendererDrawTestScene()
 {
-    rendererNewDrawList();
     rendererDrawVLine(0, 32, 256, 0xffff);
     rendererDrawVLine(119, 32, 256, 0xffff);
     rendererDrawHLine(0, 32, 120, 0xffff);
@@ -656,9 +1867,24 @@ void rendererTest()
     rendererDrawRect(8, 90, 6, 1, 0xffff);
     rendererDrawRect(9, 91, 6, 1, 0xffff);
 
+    rendererDrawBox(128, 40, 104, 40, 8, 2, 0x001f, 0xffff);
+    rendererDrawCircle(152, 120, 24, 0x07e0);
+    rendererDrawArc(208, 120, 24, 16, RENDERER_QUADRANT_TOP_RIGHT | RENDERER_QUADRANT_BOTTOM_LEFT, 0xf800);
+    rendererDrawVGradient(128, 160, 48, 64, 0xf800, 0x001f);
+    rendererDrawHGradient(180, 160, 52, 64, 0x0000, 0xffff);
+    rendererSetDrawPriority(1);
+    rendererDrawCircle(176, 192, 12, 0xffe0);
+    rendererSetDrawPriority(0);
+
 //	rendererDrawImage(&PlayButton, 32, 126);
 //	rendererDrawImage(&PlayButton, 33, 190);
+}
 
-    rendererRenderDrawList();
+void rendererTest()
+{
+    rendererNewDrawList();
+    do {
+        rendererDrawTestScene();
+    } while (rendererRenderDrawList());
 }
 
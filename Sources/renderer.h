@@ -19,23 +19,55 @@
 typedef struct _Font Font;
 typedef struct _Glyph Glyph;
 typedef struct _Image Image;
+typedef struct _TextRun TextRun;
 
 #define SCREEN_WIDTH	240
 #define SCREEN_HEIGHT	320
 
+#define RENDERER_PRIORITY_MAX	7	// Primitives of higher priority are drawn over those of lower priority
+
+#define RENDERER_QUADRANT_TOP_RIGHT		0x01
+#define RENDERER_QUADRANT_TOP_LEFT		0x02
+#define RENDERER_QUADRANT_BOTTOM_LEFT	0x04
+#define RENDERER_QUADRANT_BOTTOM_RIGHT	0x08
+#define RENDERER_QUADRANTS_ALL			0x0f
+
+// Position reached streaming a pre-rendered screen image (see image.h) to the LCD
+typedef struct _ScreenImageStream
+{
+    const uint16_t* run;	// Next pixel of a literal run, or the colour of a repeat run
+    uint16_t remaining;		// Pixels left in the current run
+    uint16_t literal;
+} ScreenImageStream;
+
 extern void rendererInit();
 extern void rendererClearScreen();
+extern void rendererStartScreenImage(ScreenImageStream* stream, const uint16_t* runs);
+extern void rendererBlitScreenImage(ScreenImageStream* stream, uint16_t y0, uint16_t y1);
 extern void rendererNewDrawList();
-extern void rendererDrawVLine(uint16_t x, uint16_t y, uint16_t length, uint16_t colour);
-extern void rendererDrawHLine(uint16_t x, uint16_t y, uint16_t length, uint16_t colour);
-extern void rendererDrawRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t colour);
-extern void rendererDrawGlyph(const Glyph* glyph, uint16_t x, uint16_t y, uint16_t colour);
-extern void rendererDrawChar(char c, uint16_t x, uint16_t y, const Font* font, uint16_t colour);
-extern void rendererDrawString(const char* s, uint16_t x, uint16_t y, const Font* font, uint16_t colour);
-extern void rendererDrawImage(const Image* i, uint16_t x, uint16_t y);
-extern void rendererRenderDrawList();
+extern void rendererNewDrawListStrip(uint16_t y0, uint16_t y1);
+extern void rendererSetDrawPriority(uint8_t priority);
+extern void rendererPushClip(int16_t x, int16_t y, uint16_t width, uint16_t height);
+extern void rendererPopClip();
+extern void rendererDrawVLine(int16_t x, int16_t y, uint16_t length, uint16_t colour);
+extern void rendererDrawHLine(int16_t x, int16_t y, uint16_t length, uint16_t colour);
+extern void rendererDrawRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour);
+extern void rendererDrawBox(int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t radius, uint8_t border, uint16_t colour, uint16_t borderColour);
+extern void rendererDrawRoundedRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t radius, uint16_t colour);
+extern void rendererDrawCircle(int16_t x, int16_t y, uint8_t radius, uint16_t colour);
+extern void rendererDrawArc(int16_t x, int16_t y, uint8_t radius, uint8_t innerRadius, uint8_t quadrants, uint16_t colour);
+extern void rendererDrawVGradient(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour0, uint16_t colour1);
+extern void rendererDrawHGradient(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t colour0, uint16_t colour1);
+extern void rendererDrawGlyph(const Glyph* glyph, int16_t x, int16_t y, uint16_t colour);
+extern void rendererDrawChar(char c, int16_t x, int16_t y, const Font* font, uint16_t colour);
+extern void rendererDrawString(const char* s, int16_t x, int16_t y, const Font* font, uint16_t colour);
+extern void rendererDrawTextRun(const TextRun* run, int16_t x, int16_t y, const Font* font, uint16_t colour);
+extern void rendererDrawImage(const Image* i, int16_t x, int16_t y);
+extern int rendererRenderDrawList();
+extern const Glyph* rendererGetGlyph(char c, const Font* font);
 extern void rendererGetStringBounds(const char* s, const Font* font, uint16_t* width, uint16_t* height);
 
+extern void rendererDrawTestScene();
 extern void rendererTest();
 
 #endif /* RENDERER_H_ */
@@ -25,8 +25,9 @@ void renderMessage(const char* message, uint16_t colour)
     y = (SCREEN_HEIGHT - height) / 2;
 
     rendererNewDrawList();
-    rendererDrawRect(x, y, width, height, 0);
-    rendererDrawString(message, x, y, &KiMony, colour);
-    rendererRenderDrawList();
+    do {
+        rendererDrawRect(x, y, width, height, 0);
+        rendererDrawString(message, x, y, &KiMony, colour);
+    } while (rendererRenderDrawList());
 }
 
@@ -0,0 +1,148 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * textwidget.c
+ *
+ *  Created on: 18 Oct 2016
+ *      Author: ntuckett
+ */
+
+#include <string.h>
+#include "textwidget.h"
+#include "renderer.h"
+#include "fontdata.h"
+#include "mathutil.h"
+
+// Finds the offset of each cell of the widget's text, and the end of the last, returning the
+// text's height
+static uint16_t layoutTextWidgetCells(const TextWidget* widget, uint16_t* cellX)
+{
+    uint16_t height = 0;
+
+    cellX[0] = 0;
+
+    for (int i = 0; i < widget->length; i++) {
+        const Glyph* glyph = rendererGetGlyph(widget->text[i], widget->font);
+
+        cellX[i + 1] = cellX[i];
+
+        if (glyph) {
+            cellX[i + 1] += glyph->width;
+            height = MAX(height, glyph->height);
+        }
+    }
+
+    return height;
+}
+
+// Clears [x0, x1) of the widget's line and draws the glyphs of its cells [first, last), returning
+// the number of primitives added
+static int renderTextWidgetCells(const TextWidget* widget, const uint16_t* cellX, uint16_t height, uint16_t x0, uint16_t x1, int first, int last)
+{
+    int primitives = 0;
+
+    if (x1 > x0 && height > 0) {
+        rendererDrawRect(widget->x + x0, widget->y, x1 - x0, height, widget->background);
+        primitives++;
+    }
+
+    for (int i = first; i < MIN(last, widget->length); i++) {
+        const Glyph* glyph = rendererGetGlyph(widget->text[i], widget->font);
+
+        if (glyph) {
+            rendererDrawGlyph(glyph, widget->x + cellX[i], widget->y, widget->colour);
+            primitives++;
+        }
+    }
+
+    return primitives;
+}
+
+void textWidgetInit(TextWidget* widget, int16_t x, int16_t y, const Font* font, uint16_t colour, uint16_t background)
+{
+    memset(widget, 0, sizeof(TextWidget));
+    widget->x = x;
+    widget->y = y;
+    widget->font = font;
+    widget->colour = colour;
+    widget->background = background;
+}
+
+// Sets the text drawn by the next render, truncated to TEXT_WIDGET_MAX_LENGTH characters
+void textWidgetSetText(TextWidget* widget, const char* text)
+{
+    uint8_t length = 0;
+
+    while (length < TEXT_WIDGET_MAX_LENGTH && text[length]) {
+        widget->text[length] = text[length];
+        length++;
+    }
+
+    widget->length = length;
+}
+
+// Forgets what was drawn, as when the screen beneath has been redrawn, so the next render draws
+// the whole text and clears nothing else
+void textWidgetInvalidate(TextWidget* widget)
+{
+    widget->drawnLength = 0;
+    widget->drawnHeight = 0;
+}
+
+// Draws the span of cells from the first that differs from what was drawn to the last: a
+// background rect covering both their old and new extents, then the new glyphs. The renderer
+// blits a single damage rect across the line, so unchanged cells within the span are drawn again.
+// Returns the number of primitives added; called again for each band if the draw list overflows.
+int textWidgetRender(const TextWidget* widget)
+{
+    uint16_t cellX[TEXT_WIDGET_MAX_LENGTH + 1];
+    uint16_t height = MAX(layoutTextWidgetCells(widget, cellX), widget->drawnHeight);
+    int cells = MAX(widget->length, widget->drawnLength);
+    int first = -1;
+    int last = -1;
+    uint16_t x0 = 0;
+    uint16_t x1 = 0;
+
+    for (int i = 0; i < cells; i++) {
+        int isSet = i < widget->length;
+        int isDrawn = i < widget->drawnLength;
+
+        if (isSet && isDrawn && widget->text[i] == widget->drawn[i] && cellX[i] == widget->drawnX[i]) {
+            continue;
+        }
+
+        uint16_t cellX0 = isSet ? cellX[i] : widget->drawnX[i];
+        uint16_t cellX1 = isSet ? cellX[i + 1] : widget->drawnX[i + 1];
+
+        if (isSet && isDrawn) {
+            cellX0 = MIN(cellX0, widget->drawnX[i]);
+            cellX1 = MAX(cellX1, widget->drawnX[i + 1]);
+        }
+
+        if (first < 0) {
+            first = i;
+            x0 = cellX0;
+        }
+        last = i + 1;
+        x1 = MAX(x1, cellX1);
+    }
+
+    if (first < 0) {
+        return 0;
+    }
+
+    return renderTextWidgetCells(widget, cellX, height, x0, x1, first, last);
+}
+
+// Records the text as drawn, once every band of the frame has been rendered
+void textWidgetRenderComplete(TextWidget* widget)
+{
+    widget->drawnHeight = layoutTextWidgetCells(widget, widget->drawnX);
+    widget->drawnLength = widget->length;
+    memcpy(widget->drawn, widget->text, widget->length);
+}
@@ -0,0 +1,48 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * textwidget.h
+ *
+ *  Created on: 18 Oct 2016
+ *      Author: ntuckett
+ */
+
+#ifndef TEXTWIDGET_H_
+#define TEXTWIDGET_H_
+
+#include <stdint.h>
+
+typedef struct _Font Font;
+
+#define TEXT_WIDGET_MAX_LENGTH	16
+
+// A line of text that remembers the character cells it has drawn, so an update draws only the
+// characters that changed or moved, and clears only what they and any shortening uncover.
+// Render each widget in a draw list of its own: the renderer blits whole damage rects, and one
+// merged with other primitives' damage may cover characters the widget does not redraw.
+typedef struct _TextWidget
+{
+    int16_t x, y;
+    const Font* font;
+    uint16_t colour;
+    uint16_t background;
+    uint8_t length;
+    uint8_t drawnLength;
+    uint16_t drawnHeight;
+    char text[TEXT_WIDGET_MAX_LENGTH];
+    char drawn[TEXT_WIDGET_MAX_LENGTH];
+    uint16_t drawnX[TEXT_WIDGET_MAX_LENGTH + 1];	// Offset of each drawn cell, then of the end of the last
+} TextWidget;
+
+extern void textWidgetInit(TextWidget* widget, int16_t x, int16_t y, const Font* font, uint16_t colour, uint16_t background);
+extern void textWidgetSetText(TextWidget* widget, const char* text);
+extern void textWidgetInvalidate(TextWidget* widget);
+extern int textWidgetRender(const TextWidget* widget);
+extern void textWidgetRenderComplete(TextWidget* widget);
+
+#endif /* TEXTWIDGET_H_ */
@@ -61,6 +61,20 @@ void tpmOneShotTimer(int timerIndex, uint32_t periodClocks, uint32_t prescaleShi
     tpmPtrs[timerIndex]->SC |= TPM_SC_CMOD(1);
 }
 
+// Starts edge aligned PWM on a channel, high for dutyClocks of every periodClocks, without
+// interrupts. With the fast internal reference clock, which runs on in stop, it carries on in VLPS.
+void tpmStartPwm(int timerIndex, uint32_t periodClocks, int channel, uint32_t dutyClocks)
+{
+    SIM_SCGC6 |= tpmGateFlags[timerIndex];
+    tpmPtrs[timerIndex]->SC = 0;
+    tpmPtrs[timerIndex]->MOD = periodClocks - 1;
+    tpmPtrs[timerIndex]->CNT = 0;
+    tpmPtrs[timerIndex]->CONTROLS[channel].CnSC = TPM_CnSC_MSB_MASK | TPM_CnSC_ELSB_MASK;
+    tpmPtrs[timerIndex]->CONTROLS[channel].CnV = dutyClocks;
+    tpmPtrs[timerIndex]->CONF = 0;
+    tpmPtrs[timerIndex]->SC = TPM_SC_CMOD(1);
+}
+
 uint32_t tpmGetTime(int timerIndex)
 {
     return tpmCounter[timerIndex];
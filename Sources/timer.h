@@ -24,6 +24,7 @@ extern void tpmInit();
 extern void tpmEnableTimer(int timerIndex);
 extern void tpmStartTimer(int timerIndex, uint32_t periodClocks, uint32_t prescaleShift);
 void tpmOneShotTimer(int timerIndex, uint32_t periodClocks, uint32_t prescaleShift);
+extern void tpmStartPwm(int timerIndex, uint32_t periodClocks, int channel, uint32_t dutyClocks);
 extern uint32_t tpmGetTime(int timerIndex);
 extern uint32_t tpmGetTimeHighPrecision(int timerIndex);
 extern void tpmStopTimer(int timerIndex);
@@ -27,15 +27,31 @@
 #define BUTTON_FLASH_COLOUR		0xffff
 #define BUTTON_FLASH_COUNT		15
 
+#define BUTTON_PRIORITY_BACKGROUND	0
+#define BUTTON_PRIORITY_CONTENT		1	// Images hide the fill beneath them
+
 #define TOUCH_STATE_IDLE			0
 #define TOUCH_STATE_PENDING			1
 #define TOUCH_STATE_ACTIVE			2
 
 #define TOUCH_DEBOUNCE_THRESHOLD	2
 
+// A button's primitives resolved from flash when the buttons are set active, so redrawing it, as
+// when pressed, replays them with only the colours and image of its state changing
+typedef struct _ButtonDisplayList
+{
+    const Image* images[2];		// Indexed by pressed state
+    const void* text;
+    uint16_t imageX[2];
+    uint16_t imageY[2];
+    uint16_t textX;
+    uint16_t textY;
+} ButtonDisplayList;
+
 typedef struct _ButtonState
 {
     const TouchButton* button;
+    ButtonDisplayList displayList;
     unsigned int dirty :1;
     unsigned int pressed :1;
     unsigned int counter :6;
@@ -48,44 +64,76 @@ static int touchState = TOUCH_STATE_IDLE;
 static int touchStateCounter = 0;
 static int currentTouchButton = -1;
 
-static void renderTouchButton(const TouchButton* button, ButtonState* state)
+static void buildTouchButtonDisplayList(const TouchButton* button, ButtonDisplayList* list)
 {
-    uint16_t colour = state->pressed ? BUTTON_FLASH_COLOUR : button->colour;
-    uint16_t textColour = state->pressed ? 0x0000 : 0xffff;
-    uint32_t imageOffset = state->pressed ? button->imageOffsets[1] : button->imageOffsets[0];
+    for (int i = 0; i < 2; i++) {
+        const Image* image = button->imageOffsets[i] ? (const Image*) GET_FLASH_PTR(button->imageOffsets[i]) : NULL;
 
-    if (!(button->flags & TB_NO_BORDER)) {
-        rendererDrawHLine(button->x, button->y, button->width, BUTTON_BORDER_COLOUR);
-        rendererDrawVLine(button->x, button->y, button->height, BUTTON_BORDER_COLOUR);
-        rendererDrawVLine(button->x + button->width - 1, button->y, button->height, BUTTON_BORDER_COLOUR);
-        rendererDrawHLine(button->x, button->y + button->height - 1, button->width, BUTTON_BORDER_COLOUR);
+        list->images[i] = image;
+
+        if (image) {
+            list->imageX[i] = button->x + (button->width / 2) - (image->width / 2);
+            list->imageY[i] = button->y + (button->height / 2) - (image->height / 2);
+        }
     }
 
+    list->text = button->textOffset ? GET_FLASH_PTR(button->textOffset) : NULL;
+
+    if (list->text) {
+        uint16_t textWidth, textHeight;
+
+        if (button->flags & TB_TEXT_RUN) {
+            textWidth = ((const TextRun*) list->text)->width;
+            textHeight = ((const TextRun*) list->text)->height;
+        } else {
+            rendererGetStringBounds((const char*) list->text, &KiMony, &textWidth, &textHeight);
+        }
+
+        if (button->flags & TB_CENTRE_TEXT) {
+            list->textX = button->x + (button->width / 2) - (textWidth / 2);
+            list->textY = button->y + (button->height / 2) - (textHeight / 2);
+        } else {
+            list->textX = button->x + 3;
+            list->textY = button->y + 3;
+        }
+    }
+}
+
+static void renderTouchButton(const TouchButton* button, const ButtonState* state)
+{
+    const ButtonDisplayList* list = &state->displayList;
+    uint16_t colour = state->pressed ? BUTTON_FLASH_COLOUR : button->colour;
+    uint16_t textColour = state->pressed ? 0x0000 : 0xffff;
+    const Image* image = list->images[state->pressed];
+
     if (!(button->flags & TB_NO_FILL)) {
         if (button->flags & TB_NO_BORDER) {
             rendererDrawRect(button->x, button->y, button->width, button->height, colour);
         } else {
-            rendererDrawRect(button->x + 1, button->y + 1, button->width - 2, button->height - 2, colour);
+            rendererDrawBox(button->x, button->y, button->width, button->height, 0, 1, colour, BUTTON_BORDER_COLOUR);
         }
+    } else if (!(button->flags & TB_NO_BORDER)) {
+        rendererDrawHLine(button->x, button->y, button->width, BUTTON_BORDER_COLOUR);
+        rendererDrawVLine(button->x, button->y, button->height, BUTTON_BORDER_COLOUR);
+        rendererDrawVLine(button->x + button->width - 1, button->y, button->height, BUTTON_BORDER_COLOUR);
+        rendererDrawHLine(button->x, button->y + button->height - 1, button->width, BUTTON_BORDER_COLOUR);
     }
 
-    if (imageOffset) {
-        const Image* image = (const Image*) GET_FLASH_PTR(imageOffset);
-        rendererDrawImage(image, button->x + (button->width / 2) - (image->width / 2), button->y + (button->height / 2) - (image->height / 2));
-    }
+    rendererSetDrawPriority(BUTTON_PRIORITY_CONTENT);
 
-    if (button->textOffset) {
-        const char* text = (const char*) GET_FLASH_PTR(button->textOffset);
-        uint16_t textWidth, textHeight;
-        rendererGetStringBounds(text, &KiMony, &textWidth, &textHeight);
+    if (image) {
+        rendererDrawImage(image, list->imageX[state->pressed], list->imageY[state->pressed]);
+    }
 
-        if (button->flags & TB_CENTRE_TEXT) {
-            rendererDrawString(text, button->x + (button->width / 2) - (textWidth / 2), button->y + (button->height / 2) - (textHeight / 2), &KiMony,
-                textColour);
+    if (list->text) {
+        if (button->flags & TB_TEXT_RUN) {
+            rendererDrawTextRun((const TextRun*) list->text, list->textX, list->textY, &KiMony, textColour);
         } else {
-            rendererDrawString(text, button->x + 3, button->y + 3, &KiMony, textColour);
+            rendererDrawString((const char*) list->text, list->textX, list->textY, &KiMony, textColour);
         }
     }
+
+    rendererSetDrawPriority(BUTTON_PRIORITY_BACKGROUND);
 }
 
 static int hitTestTouchButtons(const Point* touch)
@@ -122,23 +170,32 @@ void touchbuttonsSetActive(const TouchButton* buttons, int count)
 
     for (int i = 0; i < activeTouchButtonsCount; i++) {
         buttonState[i].button = buttons + i;
+        buildTouchButtonDisplayList(buttons + i, &buttonState[i].displayList);
         buttonState[i].dirty = 1;
         buttonState[i].pressed = 0;
         buttonState[i].counter = 0;
     }
 }
 
+// Draws the dirty buttons; called again for each band if the draw list overflows
 void touchbuttonsRender()
 {
-    //PROFILE_ENTER(drawlist);
+    PROFILE_ENTER(drawlist);
     for (int i = 0; i < activeTouchButtonsCount; i++) {
         if (buttonState[i].dirty) {
             const TouchButton* button = buttonState[i].button;
             renderTouchButton(button, buttonState + i);
-            buttonState[i].dirty = 0;
         }
     }
-    //PROFILE_EXIT(drawlist);
+    PROFILE_EXIT(drawlist);
+}
+
+// Marks the buttons drawn, once every band of the frame has been rendered
+void touchbuttonsRenderComplete()
+{
+    for (int i = 0; i < activeTouchButtonsCount; i++) {
+        buttonState[i].dirty = 0;
+    }
 }
 
 void touchbuttonsRedraw()
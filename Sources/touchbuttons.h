@@ -25,6 +25,7 @@ typedef struct _Point Point;
 #define TB_CENTRE_TEXT		0x02
 #define TB_NO_BORDER		0x04
 #define TB_NO_FILL			0x08
+#define TB_TEXT_RUN			0x10	// Text is a TextRun laid out by the config compiler, rather than a string
 
 typedef struct _TouchButton
 {
@@ -40,6 +41,7 @@ typedef struct _TouchButton
 extern void touchbuttonsInit();
 extern void touchbuttonsSetActive(const TouchButton* buttons, int count);
 extern void touchbuttonsRender();
+extern void touchbuttonsRenderComplete();
 extern void touchbuttonsRedraw();
 extern void touchbuttonsProcessTouch(const Point* touch);
 extern int touchButtonsUpdate(const Event** eventTriggered);
@@ -188,21 +188,11 @@ static uint16_t fastMedian5(uint16_t* values)
     return (values[2]);
 }
 
+// Crosses near the edge of the screen are clipped by the renderer
 static void renderCross(uint16_t x, uint16_t y, uint16_t size, uint16_t colour)
 {
-    int xclip = x - (size / 2);
-    if (xclip < 0) {
-        rendererDrawHLine(0, y, size + xclip, colour);
-    } else {
-        rendererDrawHLine(x - size / 2, y, size, colour);
-    }
-
-    int yclip = y - (size / 2);
-    if (yclip < 0) {
-        rendererDrawVLine(x, 0, size + yclip, colour);
-    } else {
-        rendererDrawVLine(x, y - size / 2, size, colour);
-    }
+    rendererDrawHLine(x - size / 2, y, size, colour);
+    rendererDrawVLine(x, y - size / 2, size, colour);
 }
 
 typedef struct _CalibrationSample
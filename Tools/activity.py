@@ -10,6 +10,8 @@ from remote import RemoteDataStruct, RemoteDataArray, RemoteDataRefArray
 from ui import ButtonMapping, GestureMapping, TouchButtonPage
 from device import DeviceState
 
+Activity_PageImages     = 0x0002    # Set when packing if the touch button pages were pre-rendered
+
 #
 # Activity - a set of touch screen buttons and physical buttons
 #
@@ -22,6 +24,7 @@ from device import DeviceState
 #       offset  touch_button_pages;         -- offset to contiguous array of button pages
 #       int     device_state_count;
 #       offset  device_states;              -- offset to contiguous array of device states
+#       offset  page_images;                -- with Activity_PageImages, offset to array of screen image offsets, one per page
 #
 # The button mappings, gesture mappings, touch button pages and device states arrays will immediately
 # follow on from the activity structure in the packed file.
@@ -44,6 +47,7 @@ class Activity(RemoteDataStruct):
         ("touch_button_pages", ct.c_uint32),
         ("device_state_count", ct.c_int),
         ("device_states", ct.c_uint32),
+        ("page_images", ct.c_uint32),
         ]
 
     def __init__(self, flags = 0, name = 'unknown'):
@@ -53,6 +57,7 @@ class Activity(RemoteDataStruct):
         self.touch_button_page_objs = []
         self.gesture_mapping_objs = []
         self.device_state_objs = []
+        self.page_images_obj = None
 
     def __str__(self):
         return "Activity %s" % self.name
@@ -88,6 +93,15 @@ class Activity(RemoteDataStruct):
 
         for x in self.device_state_objs:
             x.pre_pack_option_values(package)
+
+    # Appends pre-rendered pages, once every other object is packed
+    def pre_pack_page_images(self, package):
+        if TouchButtonPage.pre_render and self.touch_button_page_objs:
+            for x in self.touch_button_page_objs:
+                x.pre_pack_screen_image(package)
+
+            self.page_images_obj = RemoteDataRefArray([x.screen_image.ref() for x in self.touch_button_page_objs], self.name + "-page-images")
+            package.append(self.page_images_obj)
             
     def fix_up(self, package):
         self.button_mapping_count = len(self.button_mapping_objs)
@@ -118,4 +132,8 @@ class Activity(RemoteDataStruct):
             except PackageError:
                 print self, "has reference to missing device states"
 
+        if self.page_images_obj:
+            self.flags |= Activity_PageImages
+            self.page_images = package.offsetof(self.page_images_obj.ref())
+
 
@@ -0,0 +1,116 @@
+#=======================================================================
+# Copyright Nicholas Tuckett 2015.
+# Distributed under the MIT License.
+# (See accompanying file license.txt or copy at
+#  http://opensource.org/licenses/MIT)
+#=======================================================================
+#
+# Font module
+#
+
+import base64
+import io
+import os.path
+import struct
+import xml.etree.ElementTree as ET
+from PIL import Image
+
+from remote import RemoteDataObj
+
+FONT_CODE_LIMIT     = 128       # Firmware glyph tables are indexed by ASCII code
+MISSING_CHARACTER   = '*'       # Drawn in place of characters the font lacks
+INK_THRESHOLD       = 128       # Darker pixels are ink, as for the firmware's monochrome conversion
+DEFAULT_FONT_PATH   = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Resources", "KiMonyFont.xml")
+
+#
+# Glyph metrics of a font, read from the LCD Image Converter document the
+# firmware's font data is generated from
+#
+class RemoteFont(object):
+    _instances_ = {}
+
+    #
+    # Get each character's picture as PNG data
+    #
+    @staticmethod
+    def __load_glyph_pictures(path):
+        pictures = {}
+        for char in ET.parse(path).getroot().find("chars").findall("char"):
+            pictures[int(char.get("code"), 16)] = base64.b64decode(char.find("picture").text)
+        return pictures
+
+    def __init__(self, path):
+        self.path = path
+        self.name = os.path.basename(path)
+        self.glyph_pictures = RemoteFont.__load_glyph_pictures(path)
+
+        # Width and height of each picture, from its PNG header
+        self.glyph_sizes = dict((code, struct.unpack(">II", png[16:24])) for code, png in self.glyph_pictures.items())
+
+        self._instances_[path] = self
+
+    def __str__(self):
+        return "Font %s (%d glyphs)" % (self.name, len(self.glyph_sizes))
+
+    #
+    # Factory method to create or look up existing instance, given path
+    #
+    @classmethod
+    def from_path(cls, path = DEFAULT_FONT_PATH):
+        rpath = os.path.realpath(os.path.normcase(path))
+        try:
+            return cls._instances_[rpath]
+        except KeyError:
+            return cls(rpath)
+
+    #
+    # Get a glyph's ink as rows of booleans, matching the firmware's font data
+    #
+    def glyph_ink(self, code):
+        picture = Image.open(io.BytesIO(self.glyph_pictures[code])).convert("L")
+        width, height = picture.size
+        levels = list(picture.getdata())
+        return [[levels[y * width + x] < INK_THRESHOLD for x in range(width)] for y in range(height)]
+
+    #
+    # Lay out text as glyph codes, returning them with the text's width and height
+    #
+    def layout(self, text):
+        codes = []
+        width = 0
+        height = 0
+        for c in text:
+            code = ord(c)
+            if code >= FONT_CODE_LIMIT or code not in self.glyph_sizes:
+                code = ord(MISSING_CHARACTER)
+            if code in self.glyph_sizes:
+                codes.append(code)
+                width += self.glyph_sizes[code][0]
+                height = max(height, self.glyph_sizes[code][1])
+        return codes, width, height
+
+#
+# Text laid out offline, so the firmware draws it without looking up glyphs or measuring it
+#
+# C structure:
+#   uint16_t    width, height;
+#   uint16_t    length;
+#   uint8_t     codes[length];     -- glyph table indices
+#
+class RemoteTextRun(RemoteDataObj):
+    def __init__(self, text, font = None):
+        self.text = text
+        self.font = font if font else RemoteFont.from_path()
+        self.codes, self.width, self.height = self.font.layout(text)
+
+    def __str__(self):
+        return "TextRun '%s' (%d x %d)" % (self.text, self.width, self.height)
+
+    def size(self):
+        return struct.calcsize("<HHH") + len(self.codes)
+
+    def binarise(self):
+        return struct.pack("<HHH", self.width, self.height, len(self.codes)) + str(bytearray(self.codes))
+
+    def alignment(self):
+        return 2
@@ -10,19 +10,96 @@
 
 import ctypes as ct
 import os.path
+import struct
 from PIL import Image
 
-from remote import RemoteDataStruct, RemoteDataArray, RemoteDataBinaryArray
+from remote import RemoteDataObj, RemoteDataStruct, RemoteDataArray, RemoteDataBinaryArray, RemoteDataError
 
 BLACK              = (0,   0,   0)
 TRANSPARENT_COLOUR = (255, 0, 255)
 PALETTE_SIZE       = 256
-    
+
+TRANSPARENT_565    = 0xf81f
+
+FORMAT_8BPP        = 0
+FORMAT_8BPP_RLE    = 1
+FORMAT_1BPP        = 2
+FORMAT_2BPP        = 3
+FORMAT_4BPP        = 4
+
+# Packed formats as (colours including transparent, format, bits per pixel), smallest first
+PACKED_FORMATS     = [(2, FORMAT_1BPP, 1), (4, FORMAT_2BPP, 2), (16, FORMAT_4BPP, 4)]
+
+RUN_OPAQUE         = 0x80
+RUN_MAX_LENGTH     = 128
+
+# The renderer refers to an image by 16 bit word index, and to a row by its 16 bit
+# offset in the image's pixels
+MAX_IMAGE_OFFSET   = 0xffff << 2
+MAX_PIXELS_SIZE    = 0xffff
+
+#
+# Palette shared by 8 bit images in a package, holding each RGB565 colour once
+#
+# Images add their colours as they are packed, so the palette must be appended
+# to the package after all of them.
+#
+class RemoteImagePalette(RemoteDataObj):
+    def __init__(self, name = 'shared-palette'):
+        self.name = name
+        self.colours = [TRANSPARENT_565]
+
+    def __str__(self):
+        return "Palette %s (%d colours)" % (self.name, len(self.colours))
+
+    #
+    # Add colours, returning their indices; None if they do not all fit
+    #
+    def add_colours(self, colours):
+        new_colours = [x for x in colours if x not in self.colours[1:]]
+        if len(self.colours) + len(new_colours) > PALETTE_SIZE:
+            return None
+        self.colours.extend(new_colours)
+        return [self.colours.index(x, 1) for x in colours]
+
+    def size(self):
+        return len(self.colours) * ct.sizeof(ct.c_uint16)
+
+    def binarise(self):
+        return struct.pack("<%dH" % len(self.colours), *self.colours)
+
+    def alignment(self):
+        return ct.sizeof(ct.c_uint16)
+
+#
+# Image: palette and pixel indices, with index 0 transparent
+#
+# C structure:
+#   uint8_t     width, format;
+#   uint16_t    height;
+#   offset      palette, pixels;
+#
+# The format is chosen when packing from the number of distinct RGB565 colours:
+# FORMAT_1BPP, FORMAT_2BPP or FORMAT_4BPP if they fit, with each row packed into
+# whole bytes, most significant bits first. Otherwise the image's default format
+# is used.
+#
+# In FORMAT_8BPP_RLE each row is a sequence of runs, each starting with a byte n:
+# with RUN_OPAQUE set it is (n & 0x7f) + 1 pixel indices that follow, otherwise it
+# skips n + 1 transparent pixels.
+#
 class RemoteImage(RemoteDataStruct):
     _instances_ = {}
 
+    # Format for 8 bit images not given one; a config can set FORMAT_8BPP_RLE
+    default_format = FORMAT_8BPP
+
+    # Palette for 8 bit images to share; a config can set a RemoteImagePalette
+    shared_palette = None
+
     _fields_ = [
-        ("width", ct.c_uint16),
+        ("width", ct.c_uint8),
+        ("format", ct.c_uint8),
         ("height", ct.c_uint16),
         ("palette", ct.c_uint32),
         ("pixels", ct.c_uint32)
@@ -53,8 +130,89 @@ class RemoteImage(RemoteDataStruct):
     def __get_palette_rgb_565(rgb_palette):
         p = zip(rgb_palette[0::3], rgb_palette[1::3], rgb_palette[2::3])
         return [((x[0] & 0xf8) << 8)|((x[1] & 0xf8) << 3)|((x[2]) >> 3) for x in p]
+
+    #
+    # Pack one row of pixel indices into bytes, most significant bits first
+    #
+    @staticmethod
+    def __pack_row(row, bpp):
+        packed = bytearray((len(row) * bpp + 7) // 8)
+        for x, index in enumerate(row):
+            bit = x * bpp
+            packed[bit >> 3] |= index << (8 - bpp - (bit & 7))
+        return packed
+
+    #
+    # Encode one row of pixel indices as opaque and transparent runs
+    #
+    @staticmethod
+    def __encode_row_rle(row):
+        runs = bytearray()
+        x = 0
+        while x < len(row):
+            opaque = row[x] != 0
+            length = 1
+            while x + length < len(row) and length < RUN_MAX_LENGTH and (row[x + length] != 0) == opaque:
+                length += 1
+            if opaque:
+                runs.append(RUN_OPAQUE | (length - 1))
+                runs.extend(row[x:x + length])
+            else:
+                runs.append(length - 1)
+            x += length
+        return runs
+
+    #
+    # Encode pixels, remapped by index_map, in the image's format. Run-length
+    # encoding is only kept where it is smaller, e.g. for art surrounded by
+    # transparent pixels
+    #
+    def __encode_pixels(self, index_map, bpp):
+        pixels = bytearray(self.image_data.tobytes()).translate(bytearray(index_map))
+        rows = [pixels[y * self.width:(y + 1) * self.width] for y in range(self.height)]
+        if bpp < 8:
+            return str(bytearray().join(RemoteImage.__pack_row(x, bpp) for x in rows))
+        if self.format == FORMAT_8BPP_RLE:
+            encoded = bytearray().join(RemoteImage.__encode_row_rle(x) for x in rows)
+            if len(encoded) < len(pixels):
+                return str(encoded)
+            self.format = FORMAT_8BPP
+        return str(pixels)
+
+    #
+    # Choose the format and palette, returning the palette index for each
+    # colour index of the loaded image
+    #
+    def __map_palette(self, package):
+        rgb565_palette = RemoteImage.__get_palette_rgb_565(self.image_data.getpalette())
+        used = sorted(x[1] for x in self.image_data.getcolors(PALETTE_SIZE) if x[1] != 0)
+        colours = []
+        for x in used:
+            if rgb565_palette[x] not in colours:
+                colours.append(rgb565_palette[x])
+
+        packed = [x for x in PACKED_FORMATS if len(colours) < x[0]]
+        if packed:
+            self.format = packed[0][1]
+            bpp = packed[0][2]
+            indices = None
+        else:
+            bpp = 8
+            indices = RemoteImage.shared_palette.add_colours(colours) if RemoteImage.shared_palette else None
+
+        if indices:
+            self.palette_ref = RemoteImage.shared_palette
+        else:
+            indices = range(1, len(colours) + 1)
+            self.palette_ref = RemoteDataArray([TRANSPARENT_565] + colours, ct.c_uint16, self.name + "-palette")
+            package.append(self.palette_ref)
+
+        index_map = [0] * PALETTE_SIZE
+        for x in used:
+            index_map[x] = indices[colours.index(rgb565_palette[x])]
+        return index_map, bpp
     
-    def __init__(self, path):
+    def __init__(self, path, format = None):
         self.path = path
         self.name = os.path.basename(path)
         
@@ -62,6 +220,9 @@ class RemoteImage(RemoteDataStruct):
             
         self.width = self.image_data.size[0]
         self.height = self.image_data.size[1]
+        if self.width > 255:
+            raise RemoteDataError("%s is too wide" % self)
+        self.format = RemoteImage.default_format if format is None else format
         
         self._instances_[path] = self
         
@@ -79,14 +240,26 @@ class RemoteImage(RemoteDataStruct):
         except KeyError:
             return cls(rpath)
     
-    def pre_pack(self, package):
+    #
+    # Get the image's RGB565 colours as rows, with None for transparent pixels
+    #
+    def get_rgb565_rows(self):
         rgb565_palette = RemoteImage.__get_palette_rgb_565(self.image_data.getpalette())
-        self.palette_ref = RemoteDataArray(rgb565_palette, ct.c_uint16, self.name + "-palette")
-        package.append(self.palette_ref)
-        self.pixels_ref = RemoteDataBinaryArray(self.image_data.tobytes(), self.name + "-pixels")
+        pixels = bytearray(self.image_data.tobytes())
+        return [[rgb565_palette[x] if x else None for x in pixels[y * self.width:(y + 1) * self.width]] for y in range(self.height)]
+
+    def pre_pack(self, package):
+        index_map, bpp = self.__map_palette(package)
+        pixels = self.__encode_pixels(index_map, bpp)
+        if len(pixels) > MAX_PIXELS_SIZE:
+            raise RemoteDataError("%s has %d bytes of pixels, more than the renderer can address" % (self, len(pixels)))
+        self.pixels_ref = RemoteDataBinaryArray(pixels, self.name + "-pixels")
         package.append(self.pixels_ref)
         
     def fix_up(self, package):
+        offset = package.offsetof(self.ref())
+        if offset > MAX_IMAGE_OFFSET or offset % 4:
+            raise RemoteDataError("%s is at offset %d, beyond the renderer's reach" % (self, offset))
         self.palette = package.offsetof(self.palette_ref.ref())
         self.pixels = package.offsetof(self.pixels_ref.ref())
 
@@ -6,12 +6,156 @@
 #=======================================================================
 
 import ctypes as ct
-from remote import RemoteDataStruct
+import struct
+from remote import RemoteDataObj, RemoteDataStruct, RemoteDataRefArray, RemoteDataError
 
 IrEncoding_NOP  = 0
 IrEncoding_RC6  = 1
 IrEncoding_SIRC = 2
 
+IrAction_Packets = 0x0001   # Set when packing if the codes' packets were encoded
+
+IR_STAGE_COUNT   = 64       # Timings in a packet, as ir.c's IrPacket holds
+IR_MAX_DURATION  = 65535
+
+RC6_HDR_MARK     = 2666
+RC6_HDR_SPACE    = 889
+RC6_T1           = 444
+RC6_END_QUIET    = 2666
+RC6_END_DELAY    = 74000    # Quiet after sending, in microseconds
+
+SIRC_HDR_MARK    = 2440
+SIRC_HDR_SPACE   = 568
+SIRC_ONE_MARK    = 1223
+SIRC_ONE_SPACE   = 565
+SIRC_ZERO_MARK   = 626
+SIRC_ZERO_SPACE  = 565
+SIRC_GAP_MS      = 45
+SIRC_REPEATS     = 3
+SIRC_END_DELAY   = 45000
+
+#
+# Builds a packet's timings from marks and spaces, as ir.c's IrEncoder does: each timing is the
+# length of a run of marks or spaces, in microseconds
+#
+class IrEncoder(object):
+    STATE_UNDEFINED = 0
+    STATE_ON        = 1
+    STATE_OFF       = 2
+
+    def __init__(self):
+        self.state = IrEncoder.STATE_UNDEFINED
+        self.counter = 0
+        self.duration = 0
+        self.timing = []
+
+    def __record_timing(self):
+        if len(self.timing) == IR_STAGE_COUNT:
+            raise RemoteDataError("IR packet has more than %d timings" % IR_STAGE_COUNT)
+        self.timing.append(self.counter)
+        self.counter = 0
+
+    def __add(self, state, duration):
+        if self.state != state and self.state != IrEncoder.STATE_UNDEFINED:
+            self.__record_timing()
+        self.state = state
+        if self.counter + duration > IR_MAX_DURATION:
+            raise RemoteDataError("IR packet timing longer than %dus" % IR_MAX_DURATION)
+        self.counter += duration
+        self.duration += duration
+
+    def mark(self, duration):
+        self.__add(IrEncoder.STATE_ON, duration)
+
+    def space(self, duration):
+        self.__add(IrEncoder.STATE_OFF, duration)
+
+    def end(self, duration):
+        self.space(duration)
+        self.__record_timing()
+        self.state = IrEncoder.STATE_UNDEFINED
+
+#
+# Packet for the IR blaster, encoded for the firmware to send straight from flash
+#
+# C structure:
+#   uint32_t    send_ms;        -- time to send with repeats, and the quiet after
+#   uint8_t     start;          -- packet header, as sent over I2C
+#   uint8_t     repeats;
+#   uint8_t     repeat_delay;   -- milliseconds between repeats
+#   uint8_t     length;
+#   uint16_t    timing[length]; -- microseconds of each run of marks or spaces, starting with a mark
+#
+class IrPacket(RemoteDataObj):
+    def __init__(self, repeats, repeat_delay, timing, end_delay_us, name = 'unknown'):
+        self.name = name
+        self.start = 1
+        self.repeats = repeats
+        self.repeat_delay = repeat_delay
+        self.timing = timing
+
+        # As ir.c's sendIrPacket() works it out
+        total_us = sum(timing)
+        total_us += (total_us + repeat_delay) * (repeats - 1)
+        total_us += end_delay_us
+        self.send_ms = (total_us + 999) // 1000
+
+    def __str__(self):
+        return "IrPacket %s (%d timings, %dms)" % (self.name, len(self.timing), self.send_ms)
+
+    def __format(self):
+        return "<IBBBB%dH" % len(self.timing)
+
+    def size(self):
+        return struct.calcsize(self.__format())
+
+    def binarise(self):
+        return struct.pack(self.__format(), self.send_ms, self.start, self.repeats, self.repeat_delay, len(self.timing), *self.timing)
+
+    def alignment(self):
+        return 4
+
+def encode_rc6(data, bits, name = 'unknown'):
+    encoder = IrEncoder()
+    encoder.mark(RC6_HDR_MARK)
+    encoder.space(RC6_HDR_SPACE)
+
+    for i in range(0, bits):
+        t = RC6_T1 * 2 if i == 4 else RC6_T1
+        if data & (1 << (bits - 1 - i)):
+            encoder.space(t)
+            encoder.mark(t)
+        else:
+            encoder.mark(t)
+            encoder.space(t)
+
+    encoder.end(RC6_END_QUIET)
+    return IrPacket(1, 1, encoder.timing, RC6_END_DELAY, name)
+
+def encode_sirc(data, bits, name = 'unknown'):
+    encoder = IrEncoder()
+    encoder.mark(SIRC_HDR_MARK)
+    encoder.space(SIRC_HDR_SPACE)
+
+    for i in range(0, bits):
+        if data & (1 << (bits - 1 - i)):
+            encoder.mark(SIRC_ONE_MARK)
+            encoder.space(SIRC_ONE_SPACE)
+        else:
+            encoder.mark(SIRC_ZERO_MARK)
+            encoder.space(SIRC_ZERO_SPACE)
+
+    encoder.end(0)
+
+    # The gap between repeats is measured from the start of each
+    duration_ms = (encoder.duration + 999) // 1000
+    if duration_ms < SIRC_GAP_MS:
+        repeat_delay = SIRC_GAP_MS - duration_ms
+    else:
+        repeat_delay = 10
+
+    return IrPacket(SIRC_REPEATS, repeat_delay, encoder.timing, SIRC_END_DELAY, name)
+
 #
 # Single IR code that can be sent by a remote
 #
@@ -43,16 +187,34 @@ class IrCode(RemoteDataStruct):
     def __str__(self):
         return "IrCode %s %d bits %08x (%08x)" % (IrCode._encodings_[self.encoding], self.bits, self.code, self.toggle_mask)
 
+    #
+    # Encode the packet sent for this code, with its toggle bits set or not; None for a NOP
+    #
+    def encode(self, toggled, name = 'unknown'):
+        code = self.code | self.toggle_mask if toggled else self.code
+        if self.encoding == IrEncoding_RC6:
+            return encode_rc6(code, self.bits, name)
+        elif self.encoding == IrEncoding_SIRC:
+            return encode_sirc(code, self.bits, name)
+        return None
+
 #
 # Single IR 'action' consisting of one or more codes
 #
 # C structure:
-#   int     code_count;
-#   IrCode  codes[];
+#   uint16_t    code_count;
+#   uint16_t    flags;
+#   IrCode      codes[];
+#   offset      packets[];      -- with IrAction_Packets, two packets per code: toggle flag clear, then set
 #
 # This function dynamically generates a class with the right size of array for the set of codes
 # The codes are packaged as part of the structure
 #
+# With pre_encode set, the packet sent for each code is encoded when packing, so the firmware sends
+# it from flash rather than encoding it in the IR timer's interrupt. The packet offsets are packed
+# straight after the action, and the packets after them; a code with no toggle mask shares one
+# packet between both its offsets.
+#
 def IrAction(codes=None, name='unknown'):
 
     if codes:
@@ -62,16 +224,48 @@ def IrAction(codes=None, name='unknown'):
     
     class IrAction_(RemoteDataStruct):
         _fields_ = [
-            ("count", ct.c_int),
+            ("count", ct.c_uint16),
+            ("flags", ct.c_uint16),
             ("codes", IrCode * code_count)
             ]
             
         def __init__(self, name):
             self.name = name
+            self.packet_objs = []
+            self.packet_refs_obj = None
             
         def __str__(self):
             code_list = [self.codes[x] for x in range(0, len(self.codes))]
             return "IrAction %s (%s)" % (self.name, code_list)
+
+        def pre_pack(self, package):
+            if not IrAction.pre_encode:
+                return
+
+            refs = []
+            for x in range(0, self.count):
+                name = "%s-%d" % (self.name, x)
+                packet = self.codes[x].encode(False, name)
+                if packet:
+                    self.packet_objs.append(packet)
+                    toggled_packet = packet
+                    if self.codes[x].toggle_mask:
+                        toggled_packet = self.codes[x].encode(True, name + "-toggled")
+                        self.packet_objs.append(toggled_packet)
+                    refs.extend([packet.ref(), toggled_packet.ref()])
+                else:
+                    refs.extend([None, None])
+
+            self.packet_refs_obj = RemoteDataRefArray(refs, self.name + "-packets")
+            package.append(self.packet_refs_obj)
+
+        def pre_pack_trailing_children(self, package):
+            for x in self.packet_objs:
+                package.append(x)
+
+        def fix_up(self, package):
+            if self.packet_refs_obj:
+                self.flags |= IrAction_Packets
             
     o = IrAction_(name)
     o.count = code_count
@@ -82,4 +276,5 @@ def IrAction(codes=None, name='unknown'):
 
     return o
 
-
+# Whether to encode packets when packing; a config can set this, at the cost of flash for each code
+IrAction.pre_encode = False
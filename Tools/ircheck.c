@@ -0,0 +1,283 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * ircheck.c
+ *
+ *  Created on: 20 Oct 2016
+ *      Author: ntuckett
+ *
+ *  Host check of the IR packets the config compiler encodes. Every IR action reachable from a
+ *  packed config's devices and activities is sent both from its stored packets and by ir.c's own
+ *  encoders, and the bytes for the IR blaster and the delay after each compared. The time each
+ *  way takes to send a code, the work of the IR timer's interrupt bar the I2C transfer, is then
+ *  reported. Host timings only rank the two; the I2C transfer is the same either way.
+ *
+ *  Pack a config with IrAction.pre_encode set to True, then build and run from the repository root:
+ *    gcc -std=gnu99 -O2 -ISources -IIncludes Tools/ircheck.c -o ircheck
+ *    ./ircheck config.bin
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "MKL26Z4.h"
+
+// ir.c runs with its interrupt control and wait for interrupt compiled out; actions are sent a
+// code at a time by calling irSendCode() directly
+#define NVIC_DisableIRQ(irq)
+#define NVIC_EnableIRQ(irq)
+#define NVIC_SetPendingIRQ(irq)
+#define __asm(instruction)
+
+#include "ir.c"
+#include "remotedata.h"
+#include "activity.h"
+#include "device.h"
+#include "event.h"
+#include "buttons.h"
+#include "slidergesture.h"
+#include "touchbuttons.h"
+
+#define FLASH_STORE_SIZE    65536
+#define MAX_ACTIVITIES      64
+#define MAX_ACTIONS         256
+#define SEND_ITERATIONS     20000
+
+uint8_t __FlashStoreBase[FLASH_STORE_SIZE];
+
+static uint8_t sentBytes[FLASH_STORE_SIZE];
+static size_t sentLength;
+
+static uint32_t activityOffsets[MAX_ACTIVITIES];
+static int activityCount;
+static uint32_t actionOffsets[MAX_ACTIONS];
+static int actionCount;
+
+static int failures;
+
+// Host stand-ins for the I2C, timer and interrupt services ir.c uses
+void i2cSendBlock(uint8_t address, uint8_t* data, size_t length)
+{
+    memcpy(sentBytes, data, length);
+    sentLength = length;
+}
+
+void tpmEnableTimer(int timerIndex)
+{
+}
+
+void tpmStartTimer(int timerIndex, uint32_t periodClocks, uint32_t prescaleShift)
+{
+}
+
+void tpmStopTimer(int timerIndex)
+{
+}
+
+uint32_t tpmGetTime(int timerIndex)
+{
+    return 0;
+}
+
+void interruptRegisterTPMIRQHandler(TPMIRQHandler irqHandler, uint32_t tpm)
+{
+}
+
+static void check(int passed, const char* what, uint32_t offset, int code)
+{
+    if (!passed) {
+        printf("FAIL: %s, action at %u code %d\n", what, offset, code);
+        failures++;
+    }
+}
+
+static int addOffset(uint32_t* offsets, int* count, int maxCount, uint32_t offset)
+{
+    for (int i = 0; i < *count; i++) {
+        if (offsets[i] == offset) {
+            return 0;
+        }
+    }
+
+    if (*count < maxCount) {
+        offsets[(*count)++] = offset;
+    }
+
+    return 1;
+}
+
+static void addEvent(uint32_t eventOffset)
+{
+    if (!eventOffset) {
+        return;
+    }
+
+    const Event* event = (const Event*) GET_FLASH_PTR(eventOffset);
+
+    if (event->type == EVENT_IRACTION) {
+        addOffset(actionOffsets, &actionCount, MAX_ACTIONS, event->irActionOffset);
+    } else if (event->type == EVENT_ACTIVITY) {
+        addOffset(activityOffsets, &activityCount, MAX_ACTIVITIES, event->activityOffset);
+    }
+}
+
+// Finds the IR actions of each device's options, and of the events of every activity reached
+// from the home activity
+static void findActions()
+{
+    const RemoteDataHeader* header = (const RemoteDataHeader*) GET_FLASH_PTR(0);
+    const Device* devices = (const Device*) GET_FLASH_PTR(header->devicesOffset);
+
+    for (int i = 0; i < header->deviceCount; i++) {
+        const Option* options = (const Option*) GET_FLASH_PTR(devices[i].optionsOffset);
+
+        for (int j = 0; j < devices[i].optionCount; j++) {
+            const uint32_t* actionRefs = (const uint32_t*) GET_FLASH_PTR(options[j].actionsOffset);
+
+            if (options[j].preActionOffset) {
+                addOffset(actionOffsets, &actionCount, MAX_ACTIONS, options[j].preActionOffset);
+            }
+
+            for (int k = 0; k < options[j].actionCount; k++) {
+                addOffset(actionOffsets, &actionCount, MAX_ACTIONS, actionRefs[k]);
+            }
+        }
+    }
+
+    addOffset(activityOffsets, &activityCount, MAX_ACTIVITIES, header->homeActivityOffset);
+
+    for (int i = 0; i < activityCount; i++) {
+        const Activity* activity = (const Activity*) GET_FLASH_PTR(activityOffsets[i]);
+        const ButtonMapping* buttonMappings = (const ButtonMapping*) GET_FLASH_PTR(activity->buttonMappingOffset);
+        const GestureMapping* gestureMappings = (const GestureMapping*) GET_FLASH_PTR(activity->gestureMappingOffset);
+        const TouchButtonPage* pages = (const TouchButtonPage*) GET_FLASH_PTR(activity->touchButtonPagesOffset);
+
+        for (int j = 0; j < activity->buttonMappingCount; j++) {
+            addEvent(buttonMappings[j].eventOffset);
+        }
+
+        for (int j = 0; j < activity->gestureMappingCount; j++) {
+            addEvent(gestureMappings[j].eventOffset);
+        }
+
+        for (int j = 0; j < activity->touchButtonPageCount; j++) {
+            const TouchButton* buttons = (const TouchButton*) GET_FLASH_PTR(pages[j].touchButtonOffset);
+
+            for (int k = 0; k < pages[j].touchButtonCount; k++) {
+                addEvent(buttons[k].eventOffset);
+            }
+        }
+    }
+}
+
+// Sends a code from its stored packet and by encoding it, comparing what the IR blaster is sent
+static void checkCode(IrAction* action, uint32_t offset, int code, int toggled)
+{
+    uint8_t storedBytes[sizeof(IrPacket)];
+    size_t storedLength;
+    uint32_t storedDelayMs;
+
+    irSendCode(action, code, toggled);
+    storedLength = sentLength;
+    memcpy(storedBytes, sentBytes, sentLength);
+    storedDelayMs = irActionQueueDelayMs;
+
+    action->flags &= ~IR_ACTION_PACKETS;
+    irSendCode(action, code, toggled);
+    action->flags |= IR_ACTION_PACKETS;
+
+    check(storedLength == sentLength && memcmp(storedBytes, sentBytes, sentLength) == 0, toggled ? "toggled packet" : "packet", offset, code);
+    check(storedDelayMs == irActionQueueDelayMs, toggled ? "toggled delay" : "delay", offset, code);
+}
+
+static double timeCode(const IrAction* action, int code)
+{
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < SEND_ITERATIONS; i++) {
+        irSendCode(action, code, i & 1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / SEND_ITERATIONS;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* encodings[] = { "NOP", "RC6", "SIRC" };
+    double encodedNs[3] = { 0 };
+    double storedNs[3] = { 0 };
+    int codes[3] = { 0 };
+    int packedActions = 0;
+
+    if (argc < 2) {
+        printf("usage: ircheck config.bin\n");
+        return 2;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+
+    if (!file) {
+        printf("can't open %s\n", argv[1]);
+        return 2;
+    }
+
+    size_t length = fread(__FlashStoreBase, 1, FLASH_STORE_SIZE, file);
+    fclose(file);
+
+    if (length < sizeof(FlashDataHeader) + sizeof(RemoteDataHeader) || FLASH_DATA_HEADER->watermark != 0xBABABEBE) {
+        printf("%s is not a packed config\n", argv[1]);
+        return 2;
+    }
+
+    findActions();
+
+    for (int i = 0; i < actionCount; i++) {
+        IrAction* action = (IrAction*) GET_FLASH_PTR(actionOffsets[i]);
+
+        if (!(action->flags & IR_ACTION_PACKETS)) {
+            continue;
+        }
+
+        packedActions++;
+
+        for (int code = 0; code < action->codeCount; code++) {
+            unsigned int encoding = action->codes[code].encoding;
+
+            if (encoding == IRCODE_NOP || encoding > IRCODE_SIRC) {
+                continue;
+            }
+
+            checkCode(action, actionOffsets[i], code, 0);
+            if (action->codes[code].toggleMask) {
+                checkCode(action, actionOffsets[i], code, 1);
+            }
+
+            storedNs[encoding] += timeCode(action, code);
+            action->flags &= ~IR_ACTION_PACKETS;
+            encodedNs[encoding] += timeCode(action, code);
+            action->flags |= IR_ACTION_PACKETS;
+            codes[encoding]++;
+        }
+    }
+
+    printf("%d of %d IR actions have stored packets\n", packedActions, actionCount);
+    printf("%-8s %8s %12s %12s\n", "encoding", "codes", "encoded ns", "stored ns");
+
+    for (int i = IRCODE_RC6; i <= IRCODE_SIRC; i++) {
+        if (codes[i]) {
+            printf("%-8s %8d %12.1f %12.1f\n", encodings[i], codes[i], encodedNs[i] / codes[i], storedNs[i] / codes[i]);
+        }
+    }
+
+    check(packedActions > 0, "no stored packets", 0, 0);
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * kernelbench.c
+ *
+ *  Created on: 17 Oct 2016
+ *      Author: ntuckett
+ *
+ *  Host micro-benchmark for the renderer's pixel kernels. Each kernel is checked against a plain
+ *  per-pixel loop over a range of span widths and buffer alignments, then both are timed.
+ *  Host timings only rank the kernels; see plan_&_notes.txt for Cortex-M0+ cycle counts.
+ *
+ *  Build and run from the repository root:
+ *    gcc -std=gnu99 -O2 -ISources Tools/kernelbench.c Sources/pixelkernels.c -o kernelbench
+ *    ./kernelbench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pixelkernels.h"
+
+#define BUFFER_PIXELS   256
+#define SOURCE_BYTES    (BUFFER_PIXELS + 8)
+#define ITERATIONS      20000
+
+typedef void (*KernelFunc)(uint16_t* dst, const uint8_t* src, int count);
+
+static uint16_t palette[256];
+static uint8_t transparentSource[SOURCE_BYTES];
+static uint8_t opaqueSource[SOURCE_BYTES];
+static const uint8_t* source;
+
+static void referenceFill(uint16_t* dst, const uint8_t* src, int count)
+{
+    (void) src;
+
+    while (count-- > 0) {
+        *dst++ = 0x1234;
+    }
+}
+
+static void kernelFill(uint16_t* dst, const uint8_t* src, int count)
+{
+    (void) src;
+    pixelKernelFill(dst, count, 0x1234);
+}
+
+static void referenceFillMasked(uint16_t* dst, const uint8_t* src, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (src[i >> 3] & (0x80 >> (i & 7))) {
+            dst[i] = 0x1234;
+        }
+    }
+}
+
+static void kernelFillMasked(uint16_t* dst, const uint8_t* src, int count)
+{
+    for (int i = 0; i + 8 <= count; i += 8) {
+        pixelKernelFillMasked(dst + i, src[i >> 3], 0x1234);
+    }
+}
+
+static void referenceFillKeyed(uint16_t* dst, const uint8_t* src, int count)
+{
+    while (count-- > 0) {
+        if (!(*src++)) {
+            *dst = 0x1234;
+        }
+        dst++;
+    }
+}
+
+static void kernelFillKeyed(uint16_t* dst, const uint8_t* src, int count)
+{
+    pixelKernelFillKeyed(dst, src, count, 0x1234);
+}
+
+static void referenceExpand(uint16_t* dst, const uint8_t* src, int count)
+{
+    while (count-- > 0) {
+        *dst++ = palette[*src++];
+    }
+}
+
+static void kernelExpand(uint16_t* dst, const uint8_t* src, int count)
+{
+    pixelKernelExpand(dst, src, count, palette);
+}
+
+static void referenceExpandKeyed(uint16_t* dst, const uint8_t* src, int count)
+{
+    while (count-- > 0) {
+        uint8_t index = *src++;
+        if (index) {
+            *dst = palette[index];
+        }
+        dst++;
+    }
+}
+
+static void kernelExpandKeyed(uint16_t* dst, const uint8_t* src, int count)
+{
+    pixelKernelExpandKeyed(dst, src, count, palette);
+}
+
+static const struct {
+    const char* name;
+    KernelFunc reference;
+    KernelFunc kernel;
+    const uint8_t* source;
+    uint8_t wholeBytes;
+} kernels[] = {
+    { "fill", referenceFill, kernelFill, opaqueSource, 0 },
+    { "fill masked", referenceFillMasked, kernelFillMasked, transparentSource, 1 },
+    { "fill keyed", referenceFillKeyed, kernelFillKeyed, transparentSource, 0 },
+    { "expand", referenceExpand, kernelExpand, opaqueSource, 0 },
+    { "expand keyed", referenceExpandKeyed, kernelExpandKeyed, transparentSource, 0 },
+};
+
+static const int widths[] = { 1, 3, 8, 17, 64, 240 };
+
+static double getSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Times a kernel over every offset 0-3 into the buffer, returning nanoseconds per pixel
+static double timeKernel(KernelFunc func, uint16_t* buffer, int width)
+{
+    double start = getSeconds();
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int offset = 0; offset < 4; offset++) {
+            func(buffer + offset, source + offset, width);
+        }
+    }
+
+    return (getSeconds() - start) * 1e9 / ((double) ITERATIONS * 4 * width);
+}
+
+int main()
+{
+    static uint16_t expected[BUFFER_PIXELS + 8];
+    static uint16_t actual[BUFFER_PIXELS + 8];
+    int failures = 0;
+
+    srand(1);
+    for (int i = 0; i < 256; i++) {
+        palette[i] = (uint16_t) (rand() | 1);
+    }
+    for (int i = 0; i < SOURCE_BYTES; i++) {
+        opaqueSource[i] = (uint8_t) rand();
+        // Roughly a third transparent, in runs as in glyphs and cut out images
+        transparentSource[i] = ((i / 5) % 3) ? (uint8_t) rand() : 0;
+    }
+
+    printf("%-14s %6s %12s %12s %8s\n", "kernel", "width", "ref ns/pix", "kern ns/pix", "speedup");
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        source = kernels[k].source;
+
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+            int width = widths[w];
+            if (kernels[k].wholeBytes) {
+                width &= ~7;
+                if (width == 0) {
+                    continue;
+                }
+            }
+
+            for (int offset = 0; offset < 4; offset++) {
+                memset(expected, 0x5a, sizeof(expected));
+                memset(actual, 0x5a, sizeof(actual));
+                kernels[k].reference(expected + offset, source + offset, width);
+                kernels[k].kernel(actual + offset, source + offset, width);
+                if (memcmp(expected, actual, sizeof(expected))) {
+                    printf("%s: mismatch at width %d, offset %d\n", kernels[k].name, width, offset);
+                    failures++;
+                }
+            }
+
+            double referenceTime = timeKernel(kernels[k].reference, actual, width);
+            double kernelTime = timeKernel(kernels[k].kernel, actual, width);
+            printf("%-14s %6d %12.3f %12.3f %7.2fx\n", kernels[k].name, width, referenceTime, kernelTime, referenceTime / kernelTime);
+        }
+    }
+
+    printf("%s\n", failures ? "FAILED" : "all kernels match");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * MKL26Z4.h
+ *
+ *  Created on: 19 Oct 2016
+ *      Author: ntuckett
+ *
+ *  Host stand-in for the device header, found ahead of Includes/ on the include path. It takes
+ *  the register layouts from the real header, then points the GPIO and DMA blocks lcd.c drives
+ *  at the panel model, and the clock gating and DMAMUX registers at plain memory.
+ */
+
+#ifndef LCDMODEL_MKL26Z4_H_
+#define LCDMODEL_MKL26Z4_H_
+
+#include "../../Includes/MKL26Z4.h"
+#include "lcdmodel.h"
+
+#undef FGPIOB
+#undef FGPIOC
+#undef FGPIOD
+#undef FGPIOE
+#undef DMA0
+#undef DMAMUX0
+#undef SIM
+
+// Each access goes through the model, which first acts on the register write made by the one before
+#define FGPIOB      ((FGPIO_Type*) lcdModelGetPort(LCD_MODEL_PORT_B))
+#define FGPIOC      ((FGPIO_Type*) lcdModelGetPort(LCD_MODEL_PORT_C))
+#define FGPIOD      ((FGPIO_Type*) lcdModelGetPort(LCD_MODEL_PORT_D))
+#define FGPIOE      ((FGPIO_Type*) lcdModelGetPort(LCD_MODEL_PORT_E))
+#define DMA0        ((DMA_Type*) lcdModelGetDma())
+#define DMAMUX0     (&lcdModelDmaMux)
+#define SIM         (&lcdModelSim)
+
+extern DMAMUX_Type lcdModelDmaMux;
+extern SIM_Type lcdModelSim;
+
+// Interrupts are not configured on the host; waiting for one lets the model finish a DMA transfer
+#define NVIC_SetPriority(irq, priority)
+#define NVIC_EnableIRQ(irq)
+#define __disable_irq()
+#define __enable_irq()
+#define __asm(instruction)  lcdModelWaitForInterrupt()
+
+#endif /* LCDMODEL_MKL26Z4_H_ */
@@ -0,0 +1,420 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * lcdcheck.c
+ *
+ *  Created on: 19 Oct 2016
+ *      Author: ntuckett
+ *
+ *  Host check of lcd.c and the renderer against the ILI9341 bus model. Fills, CPU and DMA blits
+ *  and scrolling are compared pixel by pixel with a reference screen, rendered frames by their
+ *  profiler signature, and the bus cost of each is reported. Power, reset and sleep sequences
+ *  are checked against the datasheet's delays, waking from ambient display, sleep and power off
+ *  compared, and the ambient display's clock checked to survive the main loop's next render.
+ *
+ *  Build and run from the repository root; code must sit low enough for the renderer's 16 bit
+ *  glyph references, and DMA takes 32 bit buffer addresses:
+ *    gcc -std=gnu99 -O2 -no-pie -Wl,-Ttext-segment=0x10000 -DPROFILING -DTFT_DMA_BLIT
+ *        -ITools/lcdmodel -ISources -IIncludes Tools/lcdmodel/lcdcheck.c Tools/lcdmodel/lcdmodel.c
+ *        Sources/lcd.c Sources/renderer.c Sources/pixelkernels.c Sources/textwidget.c Sources/fontdata.c
+ *        Sources/profiler.c -o lcdcheck
+ *    ./lcdcheck
+ *
+ *  TFT_DMA_BLIT is off in lcd.h, so is defined here for the DMA blits to be checked; without it
+ *  they are sent by the CPU. Add -DTFT_PIXELS_12BIT to check the 12 bit pixel mode, where frames
+ *  are checked by pixel count alone, as the profiler's signatures are of the RGB565 pixels
+ *  rendered.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "lcdmodel.h"
+#include "lcd.h"
+#include "renderer.h"
+#include "textwidget.h"
+#include "fontdata.h"
+#include "profiler.h"
+#include "systick.h"
+
+uint8_t __FlashStoreBase[64];
+
+// Sources/image.c is generated from a picture, as plan_&_notes.txt describes; drawTestImage() is not checked
+unsigned char image_raw[4];
+unsigned int image_raw_len;
+
+#define AMBIENT_HEIGHT  24      // Rows of the strip left showing in ambient display, as main.c's
+#define AMBIENT_CLOCK_X (LCD_MODEL_WIDTH - 64)
+#define AMBIENT_CLOCK_Y 3
+
+static uint16_t screen[LCD_MODEL_HEIGHT][LCD_MODEL_WIDTH];
+static uint16_t rowBuffers[2][LCD_MODEL_WIDTH];
+static int failures;
+
+// Host stand-ins for the profiler's cycle counter
+void sysTickStartCycleCount()
+{
+}
+
+uint32_t sysTickGetCycleCount()
+{
+    return 0;
+}
+
+uint32_t sysTickStopCycleCount()
+{
+    return 0;
+}
+
+static void check(int passed, const char* what)
+{
+    if (!passed) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Compares the panel's screen with the reference, with rows scrolled by offset
+static void checkScreen(uint16_t offset, const char* what)
+{
+    int mismatches = 0;
+
+    for (int y = 0; y < LCD_MODEL_HEIGHT; y++) {
+        for (int x = 0; x < LCD_MODEL_WIDTH; x++) {
+            if (lcdModelGetScreenPixel(x, y) != screen[(y + offset) % LCD_MODEL_HEIGHT][x]) {
+                mismatches++;
+            }
+        }
+    }
+
+    if (mismatches) {
+        printf("%s: %d pixels differ\n", what, mismatches);
+    }
+    check(mismatches == 0, what);
+}
+
+static void reportCounts(const char* what)
+{
+    lcdModelSync();
+    printf("%-24s %8u %8u %8u %8u %8u %8u\n", what, lcdModelCounts.commandBytes, lcdModelCounts.dataBytes,
+           lcdModelCounts.wrStrobes, lcdModelCounts.busChanges, lcdModelCounts.dmaBytes, lcdModelCounts.pixels);
+}
+
+static void checkBus(const char* what)
+{
+    lcdModelSync();
+    check(lcdModelCounts.timingViolations == 0, what);
+    check(lcdModelCounts.busConflicts == 0, what);
+    check(lcdModelCounts.rejectedPixels == 0, what);
+}
+
+static uint16_t getPatternPixel(int x, int y)
+{
+    return (uint16_t) ((x * 0x0841) ^ (y * 0x1003) ^ 0x5a5a);
+}
+
+static void fill(int x, int y, int width, int height, uint16_t colour)
+{
+    tftStartBlit(x, y, width, height);
+    tftFill(colour, width * height);
+    tftEndBlit();
+
+    for (int row = y; row < y + height; row++) {
+        for (int column = x; column < x + width; column++) {
+            screen[row][column] = lcdModelGetStoredColour(colour);
+        }
+    }
+}
+
+// Sends a pattern a row at a time from alternate buffers, by DMA or by the CPU
+static void blit(int x, int y, int width, int height, int useDma)
+{
+    tftStartBlit(x, y, width, height);
+
+    for (int row = 0; row < height; row++) {
+        uint16_t* buffer = rowBuffers[row & 1];
+
+        for (int column = 0; column < width; column++) {
+            buffer[column] = getPatternPixel(x + column, y + row);
+            screen[y + row][x + column] = lcdModelGetStoredColour(buffer[column]);
+        }
+
+        if (useDma) {
+            tftBlitAsync(buffer, width);
+        } else {
+            tftBlit(buffer, width);
+        }
+    }
+
+    tftEndBlit();
+}
+
+static void checkSequences()
+{
+    tftInit();
+    check(!lcdModelIsShowing(), "dark after init");
+    tftSetBacklight(1);
+    check(lcdModelIsShowing(), "showing after backlight on");
+    checkBus("init bus");
+    printf("init: %u commands, %u data bytes, %ums\n", lcdModelCounts.commandBytes, lcdModelCounts.dataBytes, lcdModelTimeMs);
+
+    // The panel keeps its memory in sleep, which follows waking by at least the sleep timeout
+    fill(0, 0, LCD_MODEL_WIDTH, LCD_MODEL_HEIGHT, 0x1234);
+    sysTickDelayMs(1000);
+    tftSleep();
+    check(!lcdModelIsShowing(), "dark in sleep");
+    tftWake();
+    check(lcdModelIsShowing(), "showing after wake");
+    checkScreen(0, "memory kept in sleep");
+
+    // Memory is lost with power, and redrawn before the panel wakes
+    tftPowerOff();
+    check(!lcdModelIsShowing(), "dark with power off");
+    tftPowerOn();
+    check(lcdModelGetMemoryPixel(0, 0) == LCD_MODEL_UNDEFINED_PIXEL, "memory lost with power");
+    fill(0, 0, LCD_MODEL_WIDTH, LCD_MODEL_HEIGHT, 0x0000);
+    tftWake();
+    tftSetBacklight(1);
+    check(lcdModelIsShowing(), "showing after power on");
+    checkScreen(0, "memory drawn before wake");
+    checkBus("power and sleep bus");
+}
+
+static void checkTransfers()
+{
+    static const struct {
+        const char* name;
+        int x, y, width, height;
+        uint16_t colour;
+        int kind;
+    } transfers[] = {
+        { "fill black screen", 0, 0, 240, 320, 0x0000, 0 },
+        { "fill white rect", 10, 20, 100, 50, 0xffff, 0 },
+        { "fill colour rect", 17, 33, 41, 77, 0xf81f, 0 },
+        { "fill colour screen", 0, 0, 240, 320, 0x07e0, 0 },
+        { "fill corner pixel", 239, 319, 1, 1, 0x001f, 0 },
+        { "cpu blit rect", 5, 200, 123, 37, 0, 1 },
+        { "dma blit rect", 100, 7, 140, 90, 0, 2 },
+        { "dma blit screen", 0, 0, 240, 320, 0, 2 },
+    };
+
+    printf("%-24s %8s %8s %8s %8s %8s %8s\n", "transfer", "cmds", "data", "strobes", "bus", "dma", "pixels");
+
+    for (size_t i = 0; i < sizeof(transfers) / sizeof(transfers[0]); i++) {
+        lcdModelResetCounts();
+
+        if (transfers[i].kind == 0) {
+            fill(transfers[i].x, transfers[i].y, transfers[i].width, transfers[i].height, transfers[i].colour);
+        } else {
+            blit(transfers[i].x, transfers[i].y, transfers[i].width, transfers[i].height, transfers[i].kind == 2);
+        }
+
+        reportCounts(transfers[i].name);
+        check(lcdModelCounts.pixels == (uint32_t) transfers[i].width * transfers[i].height, transfers[i].name);
+        checkBus(transfers[i].name);
+        checkScreen(0, transfers[i].name);
+    }
+}
+
+static void checkScrolling()
+{
+    static const uint16_t offsets[] = { 1, 100, 319, 320, 0 };
+    char name[32];
+
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        tftSetScrollOffset(offsets[i]);
+        sprintf(name, "scroll offset %u", offsets[i]);
+        checkScreen(offsets[i], name);
+    }
+}
+
+// Checks ambient display shows the top strip of the reference in eight colours, under a dimmed
+// backlight, and nothing else
+static void checkAmbientScreen(const char* what)
+{
+    int mismatches = 0;
+
+    for (int y = 0; y < LCD_MODEL_HEIGHT; y++) {
+        for (int x = 0; x < LCD_MODEL_WIDTH; x++) {
+            uint16_t colour = y < AMBIENT_HEIGHT ? screen[y][x] : 0;
+
+            // Idle mode shows only the top bit of each component
+            colour = ((colour & 0x8000) ? 0xf800 : 0) | ((colour & 0x0400) ? 0x07e0 : 0) | ((colour & 0x0010) ? 0x001f : 0);
+
+            if (lcdModelGetScreenPixel(x, y) != colour) {
+                mismatches++;
+            }
+        }
+    }
+
+    if (mismatches) {
+        printf("%s: %d pixels differ\n", what, mismatches);
+    }
+    check(mismatches == 0, what);
+    check(lcdModelIsShowing() && lcdModelGetBacklight() < 100, what);
+}
+
+static void reportWake(const char* what, uint32_t startMs)
+{
+    lcdModelSync();
+    printf("%-24s %8u %8u %8u %8u\n", what, lcdModelTimeMs - startMs, lcdModelCounts.commandBytes,
+           lcdModelCounts.dataBytes, lcdModelCounts.pixels);
+}
+
+// Wakes the panel from ambient display, sleep and power off, comparing the delays each waits
+// out and what each sends before the screen shows in full
+static void checkAmbient()
+{
+    uint32_t startMs;
+
+    tftEnterAmbient(0, AMBIENT_HEIGHT);
+    checkAmbientScreen("ambient display");
+
+    // The strip can be drawn, and the renderer turning the backlight on leaves it dimmed
+    fill(200, 4, 32, 16, 0xffff);
+    tftSetBacklight(1);
+    checkAmbientScreen("drawn in ambient display");
+
+    printf("%-24s %8s %8s %8s %8s\n", "wake", "delay ms", "cmds", "data", "pixels");
+
+    lcdModelResetCounts();
+    startMs = lcdModelTimeMs;
+    tftExitAmbient();
+    reportWake("from ambient", startMs);
+    check(lcdModelGetBacklight() == 100, "full backlight after ambient");
+    checkScreen(0, "memory kept in ambient");
+
+    // Sleep from ambient leaves the panel in normal display, for sleep out to show in full
+    tftEnterAmbient(0, AMBIENT_HEIGHT);
+    tftSetBacklight(0);
+    tftExitAmbient();
+    check(!lcdModelIsShowing(), "dark leaving ambient for sleep");
+    sysTickDelayMs(1000);
+    tftSleep();
+
+    lcdModelResetCounts();
+    startMs = lcdModelTimeMs;
+    tftWake();
+    tftSetBacklight(1);
+    reportWake("from sleep", startMs);
+    checkScreen(0, "memory kept in sleep from ambient");
+
+    // Deep sleep powers the panel off, so the screen is sent again
+    sysTickDelayMs(1000);
+    tftPowerOff();
+
+    lcdModelResetCounts();
+    startMs = lcdModelTimeMs;
+    tftPowerOn();
+    blit(0, 0, LCD_MODEL_WIDTH, LCD_MODEL_HEIGHT, 1);
+    tftWake();
+    tftSetBacklight(1);
+    reportWake("from power off", startMs);
+    checkScreen(0, "memory redrawn after power off");
+    checkBus("ambient and wake bus");
+}
+
+static int countLitPixels(int x, int y, int width, int height)
+{
+    int lit = 0;
+
+    for (int row = y; row < y + height; row++) {
+        for (int column = x; column < x + width; column++) {
+            lit += lcdModelGetScreenPixel(column, row) != 0;
+        }
+    }
+
+    return lit;
+}
+
+// Draws the ambient display's clock in a draw list of its own, as main.c's updateAmbientClock()
+// does within a pass of the main loop, then renders the rest of that pass with nothing more drawn.
+// The clock's damage must not be rendered again, clearing it.
+static void checkAmbientClock()
+{
+    TextWidget clock;
+    int drawn;
+
+    fill(0, 0, LCD_MODEL_WIDTH, AMBIENT_HEIGHT, 0x0000);
+    tftEnterAmbient(0, AMBIENT_HEIGHT);
+
+    rendererNewDrawList();
+    textWidgetInit(&clock, AMBIENT_CLOCK_X, AMBIENT_CLOCK_Y, &KiMony, 0xffff, 0x0000);
+    textWidgetSetText(&clock, "1:23");
+    rendererNewDrawList();
+    do {
+        textWidgetRender(&clock);
+    } while (rendererRenderDrawList());
+    textWidgetRenderComplete(&clock);
+    drawn = countLitPixels(AMBIENT_CLOCK_X, 0, LCD_MODEL_WIDTH - AMBIENT_CLOCK_X, AMBIENT_HEIGHT);
+    check(drawn > 0, "ambient clock drawn");
+
+    while (rendererRenderDrawList());
+    check(countLitPixels(AMBIENT_CLOCK_X, 0, LCD_MODEL_WIDTH - AMBIENT_CLOCK_X, AMBIENT_HEIGHT) == drawn, "ambient clock kept by next render");
+
+    tftExitAmbient();
+    checkBus("ambient clock bus");
+}
+
+static void drawBandScene()
+{
+    rendererDrawRect(0, 0, 240, 40, 0x001f);
+    rendererDrawVGradient(0, 40, 240, 80, 0xf800, 0x07e0);
+    rendererDrawHGradient(0, 120, 240, 40, 0x0000, 0xffff);
+    rendererDrawRect(0, 160, 240, 160, 0xffff);
+    rendererSetDrawPriority(1);
+    rendererDrawString("Bus model", 20, 200, &KiMony, 0x0000);
+    rendererDrawCircle(120, 280, 30, 0xf800);
+}
+
+// Renders a frame over a black screen, then checks the panel shows what the renderer blitted
+static void checkFrame(const char* name, void (*drawScene)())
+{
+    tftStartBlit(0, 0, LCD_MODEL_WIDTH, LCD_MODEL_HEIGHT);
+    tftFill(0, LCD_MODEL_WIDTH * LCD_MODEL_HEIGHT);
+    tftEndBlit();
+    lcdModelResetCounts();
+
+    rendererNewDrawList();
+    drawScene();
+    while (rendererRenderDrawList());
+    reportCounts(name);
+    checkBus(name);
+    check(lcdModelCounts.pixels == profilerMetrics.ctr_blitBytes / sizeof(uint16_t), name);
+
+#if !defined(TFT_PIXELS_12BIT)
+    // Signatures are of the RGB565 pixels rendered, so only match the panel's in 16 bit mode
+    uint32_t signature = profilerMetrics.signature;
+
+    profilerMetrics.signature = 0;
+    for (int y = 0; y < LCD_MODEL_HEIGHT; y++) {
+        for (int x = 0; x < LCD_MODEL_WIDTH; x++) {
+            uint16_t colour = lcdModelGetScreenPixel(x, y);
+            profilerAddSignature(x, y, &colour, 1);
+        }
+    }
+
+    if (profilerMetrics.signature != signature) {
+        printf("%s: panel signature %08x, rendered %08x\n", name, profilerMetrics.signature, signature);
+    }
+    check(profilerMetrics.signature == signature, name);
+#endif
+}
+
+int main()
+{
+    checkSequences();
+    checkTransfers();
+    checkScrolling();
+    checkAmbient();
+    checkAmbientClock();
+    checkFrame("test scene frame", rendererDrawTestScene);
+    checkFrame("band scene frame", drawBandScene);
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,637 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * lcdmodel.c
+ *
+ *  Created on: 19 Oct 2016
+ *      Author: ntuckett
+ *
+ *  A register write only reaches the bus when lcd.c next touches a modelled register, as a write
+ *  is made through the pointer the access returns. Pins then change one write at a time, in order,
+ *  and the panel latches the data bus on each rising write strobe with chip select low.
+ *
+ *  DMA transfers run when the CPU waits for an interrupt, or touches the bus ports, so a buffer
+ *  changed before tftBlitWait() returns shows up as wrong pixels.
+ */
+
+#include <string.h>
+#include "MKL26Z4.h"
+#include "systick.h"
+#include "timer.h"
+#include "ports.h"
+
+#define PWR_PIN     0x00000008U     // Port B
+#define BL_PIN      0x00000008U     // Port D
+#define BL_TPM_TIMER    0           // TPM 0 CH 3, on the backlight pin
+#define BL_TPM_CHANNEL  3
+#define CS_PIN      0x01000000U     // Port E
+#define WR_PIN      0x02000000U
+#define DC_PIN      0x40000000U
+#define RS_PIN      0x80000000U
+
+#define CMD_NOP         0x00
+#define CMD_SWRESET     0x01
+#define CMD_SLPIN       0x10
+#define CMD_SLPOUT      0x11
+#define CMD_PTLON       0x12
+#define CMD_NORON       0x13
+#define CMD_DISPOFF     0x28
+#define CMD_DISPON      0x29
+#define CMD_CASET       0x2A
+#define CMD_PASET       0x2B
+#define CMD_RAMWR       0x2C
+#define CMD_PTLAR       0x30
+#define CMD_VSCRDEF     0x33
+#define CMD_MADCTL      0x36
+#define CMD_VSCRSADD    0x37
+#define CMD_IDMOFF      0x38
+#define CMD_IDMON       0x39
+#define CMD_PIXFMT      0x3A
+#define CMD_IFCTL       0xF6
+
+#define MADCTL_MY       0x80
+#define MADCTL_MX       0x40
+#define MADCTL_MV       0x20
+#define IFCTL_ENDIAN    0x20    // In the third parameter: 16 bit pixels are sent low byte first
+
+#define PIXFMT_DBI      0x07    // The MCU interface's pixel format
+#define PIXFMT_12BIT    0x03
+#define PIXFMT_16BIT    0x05
+
+#define RESET_DELAY_MS  5       // Before the next command after a reset or sleep change
+#define SLEEP_DELAY_MS  120     // Between sleep in and sleep out, either way round
+
+#define MAX_PARAMS      16
+
+typedef struct _LcdModelPanel
+{
+    uint8_t powered;
+    uint8_t asleep;
+    uint8_t displayOn;
+    uint8_t partial;            // Only lines partialStart to partialEnd are driven, the rest black
+    uint8_t idle;               // Eight colours, from the top bit of each component
+    uint8_t command;
+    uint8_t params[MAX_PARAMS];
+    uint8_t paramCount;
+    uint8_t madctl;
+    uint8_t pixelFormat;
+    uint8_t littleEndian;
+    uint8_t pixelBytes[4];
+    uint8_t pixelByteCount;
+    uint16_t columnStart, columnEnd;
+    uint16_t pageStart, pageEnd;
+    uint16_t column, page;
+    uint16_t topFixed, scrollArea, scrollStart;
+    uint16_t partialStart, partialEnd;
+    uint32_t readyMs;           // First time a command is taken after a reset or sleep change
+    uint32_t sleepChangeMs;     // First time sleep in or out is taken
+    uint16_t memory[LCD_MODEL_WIDTH * LCD_MODEL_HEIGHT];
+} LcdModelPanel;
+
+LcdModelCounts lcdModelCounts;
+uint32_t lcdModelTimeMs;
+DMAMUX_Type lcdModelDmaMux;
+SIM_Type lcdModelSim;
+
+extern void DMA2_IRQHandler();
+
+static LcdModelPanel panel;
+static FGPIO_Type ports[LCD_MODEL_PORTS];
+static uint32_t pins[LCD_MODEL_PORTS];
+static DMA_Type dma;
+static uint32_t backlightPwmPeriod;
+static uint32_t backlightPwmDuty;      // Zero unless the backlight pin is driven by PWM
+static uint32_t resetLowMs;
+static int inDma;
+static int busy;
+
+static void resetPanel()
+{
+    panel.asleep = 1;
+    panel.displayOn = 0;
+    panel.partial = 0;
+    panel.idle = 0;
+    panel.command = CMD_NOP;
+    panel.paramCount = 0;
+    panel.madctl = 0;
+    panel.pixelFormat = 0x66;
+    panel.littleEndian = 0;
+    panel.pixelByteCount = 0;
+    panel.columnStart = 0;
+    panel.columnEnd = LCD_MODEL_WIDTH - 1;
+    panel.pageStart = 0;
+    panel.pageEnd = LCD_MODEL_HEIGHT - 1;
+    panel.topFixed = 0;
+    panel.scrollArea = LCD_MODEL_HEIGHT;
+    panel.scrollStart = 0;
+    panel.partialStart = 0;
+    panel.partialEnd = LCD_MODEL_HEIGHT - 1;
+    panel.readyMs = lcdModelTimeMs + RESET_DELAY_MS;
+}
+
+static void powerOn()
+{
+    panel.powered = 1;
+    panel.sleepChangeMs = lcdModelTimeMs;
+    for (int i = 0; i < LCD_MODEL_WIDTH * LCD_MODEL_HEIGHT; i++) {
+        panel.memory[i] = LCD_MODEL_UNDEFINED_PIXEL;
+    }
+    resetPanel();
+}
+
+static void writePixel(uint16_t colour)
+{
+    int x = panel.column;
+    int y = panel.page;
+
+    if (panel.madctl & MADCTL_MV) {
+        x = panel.page;
+        y = panel.column;
+    }
+    if (panel.madctl & MADCTL_MX) {
+        x = LCD_MODEL_WIDTH - 1 - x;
+    }
+    if (panel.madctl & MADCTL_MY) {
+        y = LCD_MODEL_HEIGHT - 1 - y;
+    }
+
+    if (x >= 0 && x < LCD_MODEL_WIDTH && y >= 0 && y < LCD_MODEL_HEIGHT) {
+        panel.memory[y * LCD_MODEL_WIDTH + x] = colour;
+        lcdModelCounts.pixels++;
+    } else {
+        lcdModelCounts.rejectedPixels++;
+    }
+
+    if (++panel.column > panel.columnEnd) {
+        panel.column = panel.columnStart;
+        if (++panel.page > panel.pageEnd) {
+            panel.page = panel.pageStart;
+        }
+    }
+}
+
+// Widens an RGB444 pixel to RGB565 by repeating each component's top bits below it
+static uint16_t expandRgb444(uint16_t pixel)
+{
+    uint16_t red = (pixel >> 8) & 0x0f;
+    uint16_t green = (pixel >> 4) & 0x0f;
+    uint16_t blue = pixel & 0x0f;
+
+    return (((red << 1) | (red >> 3)) << 11) | (((green << 2) | (green >> 2)) << 5) | (blue << 1) | (blue >> 3);
+}
+
+static void writeMemoryByte(uint8_t byte)
+{
+    uint8_t* bytes = panel.pixelBytes;
+
+    bytes[panel.pixelByteCount++] = byte;
+
+    switch (panel.pixelFormat & PIXFMT_DBI) {
+    case PIXFMT_16BIT:
+        if (panel.pixelByteCount == 2) {
+            if (panel.littleEndian) {
+                writePixel(bytes[0] | (bytes[1] << 8));
+            } else {
+                writePixel((bytes[0] << 8) | bytes[1]);
+            }
+            panel.pixelByteCount = 0;
+        }
+        break;
+    case PIXFMT_12BIT:
+        // Pixel pairs in three bytes; the first is stored as soon as its blue arrives
+        if (panel.pixelByteCount == 2) {
+            writePixel(expandRgb444((bytes[0] << 4) | (bytes[1] >> 4)));
+        } else if (panel.pixelByteCount == 3) {
+            writePixel(expandRgb444(((bytes[1] & 0x0f) << 8) | bytes[2]));
+            panel.pixelByteCount = 0;
+        }
+        break;
+    default:
+        // 18 bit pixels, which lcd.c never sends
+        if (panel.pixelByteCount == 3) {
+            lcdModelCounts.rejectedPixels++;
+            panel.pixelByteCount = 0;
+        }
+        break;
+    }
+}
+
+static uint16_t getParamWord(int index)
+{
+    return (panel.params[index] << 8) | panel.params[index + 1];
+}
+
+static void writeCommand(uint8_t command)
+{
+    lcdModelCounts.commandBytes++;
+
+    if (lcdModelTimeMs < panel.readyMs) {
+        lcdModelCounts.timingViolations++;
+    }
+
+    panel.command = command;
+    panel.paramCount = 0;
+
+    switch (command) {
+    case CMD_SWRESET:
+        // Reset in sleep out must be followed by the sleep in delay before the next sleep out
+        if (!panel.asleep) {
+            panel.sleepChangeMs = lcdModelTimeMs + SLEEP_DELAY_MS;
+        }
+        resetPanel();
+        break;
+    case CMD_SLPIN:
+    case CMD_SLPOUT:
+        if (lcdModelTimeMs < panel.sleepChangeMs) {
+            lcdModelCounts.timingViolations++;
+        }
+        panel.asleep = command == CMD_SLPIN;
+        panel.readyMs = lcdModelTimeMs + RESET_DELAY_MS;
+        panel.sleepChangeMs = lcdModelTimeMs + SLEEP_DELAY_MS;
+        break;
+    case CMD_DISPOFF:
+        panel.displayOn = 0;
+        break;
+    case CMD_DISPON:
+        panel.displayOn = 1;
+        break;
+    case CMD_PTLON:
+    case CMD_NORON:
+        panel.partial = command == CMD_PTLON;
+        break;
+    case CMD_IDMOFF:
+    case CMD_IDMON:
+        panel.idle = command == CMD_IDMON;
+        break;
+    case CMD_RAMWR:
+        panel.column = panel.columnStart;
+        panel.page = panel.pageStart;
+        panel.pixelByteCount = 0;
+        break;
+    }
+}
+
+static void writeData(uint8_t byte)
+{
+    lcdModelCounts.dataBytes++;
+
+    if (panel.command == CMD_RAMWR) {
+        writeMemoryByte(byte);
+        return;
+    }
+
+    if (panel.paramCount == MAX_PARAMS) {
+        return;
+    }
+
+    panel.params[panel.paramCount++] = byte;
+
+    switch (panel.command) {
+    case CMD_CASET:
+        if (panel.paramCount == 4) {
+            panel.columnStart = getParamWord(0);
+            panel.columnEnd = getParamWord(2);
+        }
+        break;
+    case CMD_PASET:
+        if (panel.paramCount == 4) {
+            panel.pageStart = getParamWord(0);
+            panel.pageEnd = getParamWord(2);
+        }
+        break;
+    case CMD_PTLAR:
+        if (panel.paramCount == 4) {
+            panel.partialStart = getParamWord(0);
+            panel.partialEnd = getParamWord(2);
+        }
+        break;
+    case CMD_MADCTL:
+        panel.madctl = byte;
+        break;
+    case CMD_PIXFMT:
+        panel.pixelFormat = byte;
+        break;
+    case CMD_VSCRDEF:
+        if (panel.paramCount == 6) {
+            panel.topFixed = getParamWord(0);
+            panel.scrollArea = getParamWord(2);
+        }
+        break;
+    case CMD_VSCRSADD:
+        if (panel.paramCount == 2) {
+            panel.scrollStart = getParamWord(0);
+        }
+        break;
+    case CMD_IFCTL:
+        if (panel.paramCount == 3) {
+            panel.littleEndian = (byte & IFCTL_ENDIAN) != 0;
+        }
+        break;
+    }
+}
+
+// Acts on the edges between the old and new levels of a port's pins
+static void setPins(int port, uint32_t level)
+{
+    uint32_t changed = pins[port] ^ level;
+
+    pins[port] = level;
+
+    switch (port) {
+    case LCD_MODEL_PORT_B:
+        if (changed & PWR_PIN) {
+            if (level & PWR_PIN) {
+                powerOn();
+            } else {
+                panel.powered = 0;
+            }
+        }
+        break;
+    case LCD_MODEL_PORT_C:
+        if (changed & 0xff) {
+            lcdModelCounts.busChanges++;
+        }
+        break;
+    case LCD_MODEL_PORT_E:
+        if (changed & RS_PIN) {
+            // The panel ignores reset pulses under 5us, which is any with no delay between its edges
+            if (!(level & RS_PIN)) {
+                resetLowMs = lcdModelTimeMs;
+            } else if (lcdModelTimeMs > resetLowMs && panel.powered) {
+                resetPanel();
+            }
+        }
+        if ((changed & WR_PIN) && (level & WR_PIN) && !(level & CS_PIN)) {
+            lcdModelCounts.wrStrobes++;
+            if (inDma) {
+                lcdModelCounts.dmaBytes++;
+            }
+            if (panel.powered && (level & RS_PIN)) {
+                if (level & DC_PIN) {
+                    writeData(pins[LCD_MODEL_PORT_C] & 0xff);
+                } else {
+                    writeCommand(pins[LCD_MODEL_PORT_C] & 0xff);
+                }
+            }
+        }
+        break;
+    }
+}
+
+// Applies the last write made to each port's registers
+static void commitPorts()
+{
+    for (int port = 0; port < LCD_MODEL_PORTS; port++) {
+        FGPIO_Type* gpio = &ports[port];
+        uint32_t level = ((gpio->PDOR | gpio->PSOR) & ~gpio->PCOR) ^ gpio->PTOR;
+
+        gpio->PSOR = 0;
+        gpio->PCOR = 0;
+        gpio->PTOR = 0;
+        gpio->PDOR = level;
+
+        if (level != pins[port]) {
+            setPins(port, level);
+        }
+    }
+}
+
+// Writes a GPIO register by its address in either the GPIO or fast GPIO map, as DMA does
+static void writeGpioAddress(uint32_t address, uint32_t value)
+{
+    uint32_t base = address >= FGPIOA_BASE ? FGPIOA_BASE : GPIOA_BASE;
+    uint32_t stride = FGPIOB_BASE - FGPIOA_BASE;
+    uint32_t port = (address - base) / stride;
+    uint32_t offset = (address - base) % stride;
+
+    // Port A is not modelled, so port B is the first
+    if (port < 1 || port > LCD_MODEL_PORTS) {
+        return;
+    }
+
+    ((uint32_t*) &ports[port - 1])[offset / sizeof(uint32_t)] = value;
+    commitPorts();
+}
+
+static uint32_t getDmaSize(uint32_t dcr, uint32_t mask, uint32_t shift)
+{
+    static const uint32_t sizes[4] = { 4, 1, 2, 0 };
+
+    return sizes[(dcr & mask) >> shift];
+}
+
+// Makes one transfer on a channel in cycle steal mode, then any transfer linked from it
+static void runDmaTransfer(int channel)
+{
+    DMA_Type* regs = &dma;
+    uint32_t dcr = regs->DMA[channel].DCR;
+    uint32_t count = regs->DMA[channel].DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+    uint32_t sourceSize = getDmaSize(dcr, DMA_DCR_SSIZE_MASK, DMA_DCR_SSIZE_SHIFT);
+    uint32_t destSize = getDmaSize(dcr, DMA_DCR_DSIZE_MASK, DMA_DCR_DSIZE_SHIFT);
+    const uint8_t* source = (const uint8_t*) (uintptr_t) regs->DMA[channel].SAR;
+    uint32_t value = 0;
+
+    if (count == 0 || sourceSize == 0 || destSize == 0) {
+        regs->DMA[channel].DCR &= ~DMA_DCR_ERQ_MASK;
+        return;
+    }
+
+    memcpy(&value, source, sourceSize);
+    writeGpioAddress(regs->DMA[channel].DAR, value);
+
+    if (dcr & DMA_DCR_SINC_MASK) {
+        regs->DMA[channel].SAR += sourceSize;
+    }
+    if (dcr & DMA_DCR_DINC_MASK) {
+        regs->DMA[channel].DAR += destSize;
+    }
+
+    count -= count < sourceSize ? count : sourceSize;
+    regs->DMA[channel].DSR_BCR = count;
+
+    if (count == 0 && (dcr & DMA_DCR_D_REQ_MASK)) {
+        regs->DMA[channel].DCR &= ~DMA_DCR_ERQ_MASK;
+    }
+
+    switch ((dcr & DMA_DCR_LINKCC_MASK) >> DMA_DCR_LINKCC_SHIFT) {
+    case 1:
+        runDmaTransfer((dcr & DMA_DCR_LCH1_MASK) >> DMA_DCR_LCH1_SHIFT);
+        if (count == 0) {
+            runDmaTransfer((dcr & DMA_DCR_LCH2_MASK) >> DMA_DCR_LCH2_SHIFT);
+        }
+        break;
+    case 2:
+        runDmaTransfer((dcr & DMA_DCR_LCH1_MASK) >> DMA_DCR_LCH1_SHIFT);
+        break;
+    case 3:
+        if (count == 0) {
+            runDmaTransfer((dcr & DMA_DCR_LCH1_MASK) >> DMA_DCR_LCH1_SHIFT);
+        }
+        break;
+    }
+
+    if (count == 0 && (dcr & DMA_DCR_EINT_MASK) && channel == 2) {
+        DMA2_IRQHandler();
+    }
+}
+
+static int isDmaPending()
+{
+    return (dma.DMA[0].DCR & DMA_DCR_ERQ_MASK) && (dma.DMA[0].DSR_BCR & DMA_DSR_BCR_BCR_MASK);
+}
+
+// Runs a requested transfer on channel 0, the one lcd.c starts, to completion
+static void runDma()
+{
+    inDma = 1;
+    while (isDmaPending()) {
+        runDmaTransfer(0);
+    }
+    inDma = 0;
+}
+
+static void commit(int runPendingDma)
+{
+    if (busy) {
+        return;
+    }
+
+    busy = 1;
+    commitPorts();
+    if (runPendingDma) {
+        runDma();
+    }
+    busy = 0;
+}
+
+volatile void* lcdModelGetPort(int port)
+{
+    // The bus pins belong to the DMA until its transfer is done
+    if ((port == LCD_MODEL_PORT_C || port == LCD_MODEL_PORT_E) && isDmaPending()) {
+        lcdModelCounts.busConflicts++;
+    }
+
+    commit(1);
+    return &ports[port];
+}
+
+volatile void* lcdModelGetDma()
+{
+    commit(0);
+    return &dma;
+}
+
+void lcdModelWaitForInterrupt()
+{
+    commit(1);
+}
+
+// Applies any outstanding register write and DMA transfer, before reading the model's state
+void lcdModelSync()
+{
+    commit(1);
+}
+
+void lcdModelResetCounts()
+{
+    lcdModelSync();
+    memset(&lcdModelCounts, 0, sizeof(lcdModelCounts));
+}
+
+// Whether the panel is showing its memory: powered, awake, display on and backlit
+int lcdModelIsShowing()
+{
+    lcdModelSync();
+    return panel.powered && !panel.asleep && panel.displayOn && lcdModelGetBacklight() > 0;
+}
+
+// Gets the backlight's brightness as a percentage, from its pin or the duty of the PWM driving it
+int lcdModelGetBacklight()
+{
+    lcdModelSync();
+
+    if (backlightPwmDuty) {
+        return backlightPwmDuty * 100 / backlightPwmPeriod;
+    }
+
+    return (pins[LCD_MODEL_PORT_D] & BL_PIN) ? 100 : 0;
+}
+
+// Gets the RGB565 colour the panel stores for one sent in its current pixel format
+uint16_t lcdModelGetStoredColour(uint16_t colour)
+{
+    lcdModelSync();
+
+    if ((panel.pixelFormat & PIXFMT_DBI) == PIXFMT_12BIT) {
+        return expandRgb444(((colour >> 4) & 0xf00) | ((colour >> 3) & 0x0f0) | ((colour >> 1) & 0x00f));
+    }
+
+    return colour;
+}
+
+uint16_t lcdModelGetMemoryPixel(int x, int y)
+{
+    lcdModelSync();
+    return panel.memory[y * LCD_MODEL_WIDTH + x];
+}
+
+// Gets the pixel shown at a screen position. Gate line 0 is at the bottom of the screen as
+// fitted, and the vertical scroll picks the memory row each gate line shows. Partial mode blacks
+// out lines outside the partial area, and idle mode leaves each component fully on or off.
+uint16_t lcdModelGetScreenPixel(int x, int y)
+{
+    int line = LCD_MODEL_HEIGHT - 1 - y;
+    int row = line;
+
+    if (line >= panel.topFixed && line < panel.topFixed + panel.scrollArea && panel.scrollStart >= panel.topFixed) {
+        row = panel.topFixed + (panel.scrollStart - panel.topFixed + line - panel.topFixed) % panel.scrollArea;
+    }
+
+    if (panel.partial && (line < panel.partialStart || line > panel.partialEnd)) {
+        return 0x0000;
+    }
+
+    uint16_t colour = lcdModelGetMemoryPixel(x, row);
+
+    if (panel.idle) {
+        colour = ((colour & 0x8000) ? 0xf800 : 0) | ((colour & 0x0400) ? 0x07e0 : 0) | ((colour & 0x0010) ? 0x001f : 0);
+    }
+
+    return colour;
+}
+
+// Host stand-ins for the services lcd.c uses. Time only passes in delays.
+void sysTickDelayMs(unsigned int delayMs)
+{
+    lcdModelSync();
+    lcdModelTimeMs += delayMs;
+}
+
+void portInitialise(PortConfigPtr config)
+{
+}
+
+// Only the backlight's timer is modelled
+void tpmStartPwm(int timerIndex, uint32_t periodClocks, int channel, uint32_t dutyClocks)
+{
+    if (timerIndex == BL_TPM_TIMER && channel == BL_TPM_CHANNEL) {
+        backlightPwmPeriod = periodClocks;
+        backlightPwmDuty = dutyClocks;
+    }
+}
+
+void tpmStopTimer(int timerIndex)
+{
+    if (timerIndex == BL_TPM_TIMER) {
+        backlightPwmDuty = 0;
+    }
+}
+
+void tpmDisableTimer(int timerIndex)
+{
+}
@@ -0,0 +1,65 @@
+//=======================================================================
+// Copyright Nicholas Tuckett 2015.
+// Distributed under the MIT License.
+// (See accompanying file license.txt or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * lcdmodel.h
+ *
+ *  Created on: 19 Oct 2016
+ *      Author: ntuckett
+ *
+ *  Bus level model of the ILI9341 panel, driven by an unmodified lcd.c built on a host. The
+ *  MKL26Z4.h in this directory points the GPIO and DMA registers lcd.c writes at the model.
+ */
+
+#ifndef LCDMODEL_H_
+#define LCDMODEL_H_
+
+#include <stdint.h>
+
+#define LCD_MODEL_WIDTH             240
+#define LCD_MODEL_HEIGHT            320
+#define LCD_MODEL_UNDEFINED_PIXEL   0xa5a5  // Panel memory content after power on
+
+enum
+{
+    LCD_MODEL_PORT_B,
+    LCD_MODEL_PORT_C,
+    LCD_MODEL_PORT_D,
+    LCD_MODEL_PORT_E,
+    LCD_MODEL_PORTS
+};
+
+// Bus activity since the counts were last reset
+typedef struct _LcdModelCounts
+{
+    uint32_t wrStrobes;         // Write strobes with the panel selected
+    uint32_t commandBytes;
+    uint32_t dataBytes;
+    uint32_t busChanges;        // Writes that changed the level of any data line
+    uint32_t dmaBytes;          // Bytes sent by DMA rather than the CPU
+    uint32_t pixels;            // Pixels written to panel memory
+    uint32_t rejectedPixels;    // Pixels written outside panel memory or in a format not modelled
+    uint32_t timingViolations;  // Commands sent sooner after reset or sleep changes than the datasheet allows
+    uint32_t busConflicts;      // CPU accesses to the bus ports while a DMA transfer is outstanding
+} LcdModelCounts;
+
+extern LcdModelCounts lcdModelCounts;
+extern uint32_t lcdModelTimeMs;     // Time passed in sysTickDelayMs()
+
+extern volatile void* lcdModelGetPort(int port);
+extern volatile void* lcdModelGetDma();
+extern void lcdModelWaitForInterrupt();
+extern void lcdModelSync();
+extern void lcdModelResetCounts();
+
+extern int lcdModelIsShowing();
+extern int lcdModelGetBacklight();
+extern uint16_t lcdModelGetStoredColour(uint16_t colour);
+extern uint16_t lcdModelGetMemoryPixel(int x, int y);
+extern uint16_t lcdModelGetScreenPixel(int x, int y);
+
+#endif /* LCDMODEL_H_ */
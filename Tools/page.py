@@ -0,0 +1,160 @@
+#=======================================================================
+# Copyright Nicholas Tuckett 2015.
+# Distributed under the MIT License.
+# (See accompanying file license.txt or copy at
+#  http://opensource.org/licenses/MIT)
+#=======================================================================
+#
+# Page module
+#
+# Pre-renders touch button pages in their resting state, drawn as the firmware's
+# touchbuttons.c would draw them, so the firmware can send them straight to the LCD.
+#
+
+import struct
+
+from remote import RemoteDataObj
+
+SCREEN_WIDTH         = 240
+SCREEN_HEIGHT        = 320
+
+BUTTON_BORDER_COLOUR = 0xffff
+BUTTON_TEXT_COLOUR   = 0xffff
+BUTTON_TEXT_INSET    = 3        # Offset of text not centred in its button
+
+RUN_LITERAL          = 0x8000
+RUN_MAX_LENGTH       = 0x8000
+RUN_MIN_REPEAT       = 3        # Shorter repeats cost as much as literal pixels, and take longer to send
+
+#
+# RGB565 framebuffer drawn into like the firmware's renderer, clipped to the screen
+#
+class PageRenderer(object):
+    def __init__(self):
+        self.pixels = [0] * (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+    def plot(self, x, y, colour):
+        if 0 <= x < SCREEN_WIDTH and 0 <= y < SCREEN_HEIGHT:
+            self.pixels[y * SCREEN_WIDTH + x] = colour
+
+    def fill(self, x, y, width, height, colour):
+        for row in range(max(y, 0), min(y + height, SCREEN_HEIGHT)):
+            for column in range(max(x, 0), min(x + width, SCREEN_WIDTH)):
+                self.pixels[row * SCREEN_WIDTH + column] = colour
+
+    def draw_image(self, image, x, y):
+        for row, colours in enumerate(image.get_rgb565_rows()):
+            for column, colour in enumerate(colours):
+                if colour is not None:
+                    self.plot(x + column, y + row, colour)
+
+    def draw_text_run(self, run, x, y, colour):
+        for code in run.codes:
+            ink = run.font.glyph_ink(code)
+            for row, bits in enumerate(ink):
+                for column, bit in enumerate(bits):
+                    if bit:
+                        self.plot(x + column, y + row, colour)
+            x += run.font.glyph_sizes[code][0]
+
+    #
+    # Draw a button's fill and border, as renderTouchButton() does
+    #
+    def draw_button_background(self, button):
+        x, y, width, height = button.x, button.y, button.width, button.height
+        if not button.flags & button.FLAGS_NO_FILL:
+            if button.flags & button.FLAGS_NO_BORDER:
+                self.fill(x, y, width, height, button.colour)
+            else:
+                self.fill(x, y, width, height, BUTTON_BORDER_COLOUR)
+                self.fill(x + 1, y + 1, width - 2, height - 2, button.colour)
+        elif not button.flags & button.FLAGS_NO_BORDER:
+            self.fill(x, y, width, 1, BUTTON_BORDER_COLOUR)
+            self.fill(x, y, 1, height, BUTTON_BORDER_COLOUR)
+            self.fill(x + width - 1, y, 1, height, BUTTON_BORDER_COLOUR)
+            self.fill(x, y + height - 1, width, 1, BUTTON_BORDER_COLOUR)
+
+    #
+    # Draw a button's unpressed image and text, as buildTouchButtonDisplayList() places them
+    #
+    def draw_button_content(self, button):
+        if button.image1_ref:
+            image = button.image1_obj
+            self.draw_image(image, button.x + button.width // 2 - image.width // 2, button.y + button.height // 2 - image.height // 2)
+
+        if button.wrapped_text:
+            run = button.wrapped_text
+            if button.flags & button.FLAGS_CENTRE_TEXT:
+                x = button.x + button.width // 2 - run.width // 2
+                y = button.y + button.height // 2 - run.height // 2
+            else:
+                x = button.x + BUTTON_TEXT_INSET
+                y = button.y + BUTTON_TEXT_INSET
+            self.draw_text_run(run, x, y, BUTTON_TEXT_COLOUR)
+
+    #
+    # Draw a page of buttons; images and text have the higher draw priority, so go over every fill
+    #
+    def draw_page(self, touch_buttons):
+        for x in touch_buttons:
+            self.draw_button_background(x)
+        for x in touch_buttons:
+            self.draw_button_content(x)
+        return self.pixels
+
+#
+# Screen image: a whole screen of RGB565 pixels in raster order, as runs
+#
+# Each run starts with a 16 bit word n. With RUN_LITERAL set it is (n & 0x7fff) + 1
+# pixels that follow, otherwise it repeats the colour in the following word n + 1
+# times. Runs may cross rows, as the firmware sends the screen as one LCD window.
+#
+class RemoteScreenImage(RemoteDataObj):
+    def __init__(self, pixels, name = 'unknown'):
+        self.name = name
+        self.words = RemoteScreenImage.__encode_runs(pixels)
+
+    def __str__(self):
+        return "ScreenImage %s (%d bytes)" % (self.name, self.size())
+
+    @staticmethod
+    def __encode_runs(pixels):
+        words = []
+        literal = []
+
+        def flush_literal():
+            while literal:
+                chunk = literal[:RUN_MAX_LENGTH]
+                words.append(RUN_LITERAL | (len(chunk) - 1))
+                words.extend(chunk)
+                del literal[:len(chunk)]
+
+        x = 0
+        while x < len(pixels):
+            length = 1
+            while x + length < len(pixels) and length < RUN_MAX_LENGTH and pixels[x + length] == pixels[x]:
+                length += 1
+            if length >= RUN_MIN_REPEAT:
+                flush_literal()
+                words.extend([length - 1, pixels[x]])
+            else:
+                literal.extend(pixels[x:x + length])
+            x += length
+
+        flush_literal()
+        return words
+
+    def size(self):
+        return len(self.words) * struct.calcsize("<H")
+
+    def binarise(self):
+        return struct.pack("<%dH" % len(self.words), *self.words)
+
+    def alignment(self):
+        return struct.calcsize("<H")
+
+#
+# Pre-render a page of touch buttons as a screen image
+#
+def render_page(touch_buttons, name = 'unknown'):
+    return RemoteScreenImage(PageRenderer().draw_page(touch_buttons), name)
@@ -178,6 +178,8 @@ class Package:
         obj.pre_pack_trailing_children(self)
         
     def append_text(self, text):
+        misalignment = self.text_offset % text.alignment()
+        self.text_offset += (text.alignment() - misalignment) % text.alignment()
         self.offsets[text.ref()] = self.text_offset
         self.texts.append(text)
         self.text_offset += text.size()
@@ -186,6 +188,8 @@ class Package:
         packed_objects = [ struct.pack("<I", WATERMARK) ]
         packed_offset = 0
         
+        # Texts keep their alignment relative to the start of the text area
+        self.align_to(4)
         for text in self.texts:
             self.offsets[text.ref()] += self.next_offset
         
@@ -9,6 +9,7 @@ import ctypes as ct
 from remote import RemoteDataStruct
 from ui import *
 from device import *
+from image import RemoteImage
 
 #
 # Top level structure that pulls together the entire remote data set
@@ -76,6 +77,13 @@ class RemoteConfig(RemoteDataStruct):
         for device in self.devices_list:
             device.pre_pack_options_and_actions(package)
 
+        # Only complete once every image has been packed
+        if RemoteImage.shared_palette:
+            package.append(RemoteImage.shared_palette)
+
+        for activity in self.activities:
+            activity.pre_pack_page_images(package)
+
     def fix_up(self, package):        
         self.devices_count = len(self.devices_list)
 
@@ -6,8 +6,10 @@
 #=======================================================================
 
 import ctypes as ct
-from remote import RemoteDataStruct, RemoteDataStr, RemoteDataError
+from remote import RemoteDataStruct, RemoteDataError
 from image import RemoteImage
+from font import RemoteTextRun
+from page import render_page
 from ir import IrAction
 
 Event_NONE      = 0
@@ -133,7 +135,7 @@ class GestureMapping(RemoteDataStruct):
 #
 # C structure:
 #   offset      event;
-#   offset      text;
+#   offset      text;               -- text run if FLAGS_TEXT_RUN, otherwise a string
 #   uint16_t    x, y, width, height, colour, flags;
 #   offset      image1, image2;
 #
@@ -155,6 +157,7 @@ class TouchButton(RemoteDataStruct):
     FLAGS_CENTRE_TEXT    = 0x0002
     FLAGS_NO_BORDER      = 0x0004
     FLAGS_NO_FILL        = 0x0008
+    FLAGS_TEXT_RUN       = 0x0010
         
     def __init__(self, event, text, x, y, width, height, colour, flags = 0, image1 = None, image2 = None, name = None):
         if name:
@@ -167,8 +170,9 @@ class TouchButton(RemoteDataStruct):
             self.name = 'unknown'
 
         if text:
-            self.wrapped_text = RemoteDataStr(text)
+            self.wrapped_text = RemoteTextRun(text)
             self.text_ref  = self.wrapped_text.ref()
+            flags |= TouchButton.FLAGS_TEXT_RUN
         else:
             self.wrapped_text = None
             self.text_ref = None
@@ -240,7 +244,15 @@ class TouchButton(RemoteDataStruct):
 # As a page has a variable number of buttons, the button array is kept separate so that multipe pages
 # can be packed into one contiguous array using pre_pack_trailing_children().
 #
+# With pre_render set, each page's resting state is also drawn offline as a screen image, which the
+# activity lists for the firmware to send to the LCD instead of drawing the page. Screen images are
+# several KB each, so are appended after everything else with pre_pack_screen_image(), leaving the
+# images the renderer draws low in the package.
+#
 class TouchButtonPage(RemoteDataStruct):
+    # Whether to pre-render pages; a config can set this, at the cost of a few KB of flash per page
+    pre_render = False
+
     _fields_ = [
         ("count", ct.c_int),
         ("buttons", ct.c_uint32)
@@ -250,6 +262,7 @@ class TouchButtonPage(RemoteDataStruct):
         self.name = name;
         self.touch_buttons = touch_buttons
         self.count = len(touch_buttons)
+        self.screen_image = None
         if touch_buttons:
             self.buttons_ref = touch_buttons[0].ref()
         else:
@@ -264,6 +277,10 @@ class TouchButtonPage(RemoteDataStruct):
             
         for x in self.touch_buttons:
             x.pre_pack_images(package)
+
+    def pre_pack_screen_image(self, package):
+        self.screen_image = render_page(self.touch_buttons, self.name + "-image")
+        package.append(self.screen_image)
             
     def fix_up(self, package):
         try: